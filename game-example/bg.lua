@@ -1,29 +1,20 @@
+local kBgDown, kBgUp = 1, 2
+
 function make_bg()
+    -- bg_down scrolls at 1/5 of the camera and sinks up to 16px over 30 tiles of height
+    ui.bg_layer(kBgDown, CurrentStage.bg_down, { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }, 165, 1 / 5, 16 / (30 * 16), 16)
+    ui.bg_layer(kBgUp, CurrentStage.bg_up, { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14 }, 0, 1 / 4)
+
     return {
         before_frame = function(frame, camera, player, map)
 
         end,
         on_frame = function(frame, camera, player, map)
             local camx, camy = camera.getxy()
-            local dx = (camx // 5)
-            local dy = (math.min(1, (camy / (30 * 16))) * 16) // 1
-            local tile_id = 0
 
             ui.rectfill(0, 0, 480, 270, CurrentStage.bg_tint)
-            local tileset = CurrentStage.bg_down
-
-            for x = 0, 32 do
-                tile_id = ((x * 16 + dx) // 16) % 10
-                ui.tile(tileset, tile_id, x * 16 - (dx % 16), 165 - dy)
-            end
-
-            tileset = CurrentStage.bg_up
-            dx = (camx // 4)
-
-            for x = 0, 32 do
-                tile_id = ((x * 16 + dx) // 16) % 15
-                ui.tile(tileset, tile_id, x * 16 - (dx % 16), 0)
-            end
+            ui.bg_draw(kBgDown, camx, camy)
+            ui.bg_draw(kBgUp, camx, camy)
         end
     }
 end
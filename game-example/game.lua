@@ -57,14 +57,21 @@ local function draw()
     Frame = Frame + 1
 
     if Scene == nil then
+        ui.begin_assets("overworld")
         Scene = make_overworld()
     end
 
     if Scene.is_finished() == true then
         math.randomseed(os.time())
         Frame = 0
-        Scene = Scene.name() == "game" and make_overworld() or make_game()
-        collectgarbage("collect")
+
+        -- sheets, tilemaps and lists of the old scene go away once this frame is drawn
+        local next_scene = Scene.name() == "game" and "overworld" or "game"
+        ui.release_assets(Scene.name())
+        ui.begin_assets(next_scene)
+        Scene = next_scene == "game" and make_game() or make_overworld()
+        -- the old scene's garbage is collected over the next frames
+        sys.gc_collect()
     end
 
     Scene.draw(Frame)
@@ -81,4 +88,3 @@ for i = 1, #Palette do
 end
 
 -- sfx.music("orca")
-collectgarbage("generational")
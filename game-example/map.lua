@@ -1,42 +1,34 @@
+local tiles = nil
+local animated = false
+
 function make_map()
-    local data = require(CurrentStage.map_name)
+    -- binary map next to the Lua one; chunks are decoded around the camera
+    local map_file = ui.map_open(package.searchpath(CurrentStage.map_name, (package.path:gsub("%.lua", ".lmap"))))
+
+    -- water and grass animate per tile instead of swapping the whole sheet
+    if not animated then
+        ui.tile_anim_sheets(SpriteSheets['tilemap.sunny.1'], {
+            SpriteSheets['tilemap.sunny.2'],
+            SpriteSheets['tilemap.sunny.3'],
+            SpriteSheets['tilemap.sunny.4']
+        }, 8)
+        animated = true
+    end
 
-    local function get_map_size()
-        local size = { height = #data * 16, width = 0 }
+    -- the previous map was released with its scene's asset group
+    tiles = ui.tilemap(map_file, kMapID.tile)
 
-        for _, vy in pairs(data) do
-            for x, _ in pairs(vy) do
-                if x * 16 > size.width then size.width = x * 16 end
-            end
-        end
+    local function get_map_size()
+        local width, height = ui.map_size(map_file)
 
-        return size
+        return { height = height * 16, width = width * 16 }
     end
 
     local function draw(frame, camera)
         local camx, camy = camera.getxy()
 
-        local ystart = 1 + camy // 16
-        local yend = ystart + 17
-        local xstart = 1 + camx // 16
-        local xend = xstart + 30
-
-        local tileset = SpriteSheets['tilemap.sunny.' .. 1 + ((frame // 8) % 4)]
-
-        for y = ystart, yend do
-            local line = data[y]
-            if line ~= nil then
-                for x = xstart, xend do
-                    local vx = line[x]
-                    if vx ~= nil then
-                        local tile = vx[kMapID.tile]
-                        if tile then 
-                            ui.tile(tileset, tile - 1, 16 * (x - 1) - camx, 16 * (y - 1) - camy)
-                        end 
-                    end
-                end
-            end
-        end
+        ui.map_stream(map_file, camx, camy)
+        ui.tilemap_draw(tiles, SpriteSheets['tilemap.sunny.1'], camx, camy)
     end
 
     return {
@@ -47,30 +39,14 @@ function make_map()
         on_frame = function(frame, camera, player, map)
             draw(frame, camera)
         end,
-        colides = function(x, y, type)
-            local row = data[1 + y // 16]
-            if row == nil then return false end
-            local tile = row[1 + x // 16]
-            if tile == nil then return false end
-            local type_id = tile[kMapID.colision]
-            if type_id == nil then return false end
-            local types = kColisionTile[type_id]
-
-            for _, atype in pairs(types) do
-                if atype == type then return true end
-            end
-            return false
+        -- kinematic body that collides against this map's collision layer
+        body = function(settings)
+            return ui.body(map_file, kMapID.colision, kColisionTile, settings)
         end,
         get_pois = function()
             local pois = {}
-            for y, line in pairs(data) do
-                for x, tile in pairs(line) do
-                    local poi = tile[kMapID.poi]
-                    if poi ~= 0 and poi ~= nil then
-                        table.insert(pois, { x = x, y = y, poi = poi })
-                        -- print("poi at x:" .. x .. " y:" .. y .. " value:" .. poi)
-                    end
-                end
+            for _, cell in ipairs(ui.map_cells(map_file, kMapID.poi)) do
+                table.insert(pois, { x = cell.x, y = cell.y, poi = cell.value })
             end
             return pois
         end
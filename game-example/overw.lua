@@ -15,9 +15,22 @@ MapStages = {
     end
 }
 
+local world_layers = {}
+local props_animated = false
+
 function make_overworld()
     local data = require("world")
 
+    -- props ping-pong through their five frames, eight frames each
+    if not props_animated then
+        local frames = {}
+        for _, f in ipairs({ 2, 3, 4, 5, 4, 3, 2 }) do
+            table.insert(frames, SpriteSheets['tilemap.wprops.' .. f])
+        end
+        ui.tile_anim_sheets(SpriteSheets['tilemap.wprops.1'], frames, 8)
+        props_animated = true
+    end
+
     local kPlayerDir = {
         up = 1,
         down = 2,
@@ -238,29 +251,15 @@ function make_overworld()
     end
 
     local function draw_layer(frame, layer_type, tiles)
-        local ystart = 1 + camy // 16
-        local yend = ystart + 17
-        local xstart = 1 + camx // 16
-        local xend = xstart + 30
-
-        for y = ystart, yend do
-            local line = data[y]
-            if line ~= nil then
-                for x = xstart, xend do
-                    local vx = line[x]
-                    if vx ~= nil then
-                        local tile = vx[layer_type]
-                        if tile ~= nil and tile ~= 0 and type(tile) == "number" then
-                            ui.tile(tiles, tile - 1, 16 * (x - 1) - camx, 16 * (y - 1) - camy)
-                        end
-                    end
-                end
-            end
-        end
+        ui.tilemap_draw(world_layers[layer_type], tiles, camx, camy)
     end
 
     update_map()
 
+    for _, layer in ipairs({ kMapID.tile, kMapID.overlay }) do
+        world_layers[layer] = ui.tilemap(data, layer)
+    end
+
     return {
         name = function() return "overworld" end,
         update = function() end,
@@ -292,12 +291,16 @@ function make_overworld()
                     table.insert(MapStages.stages,
                         { x = MapStages.current.x, y = MapStages.current.y, done = MapStages.current.done })
                     move_to_next = 1
+
+                    -- upload the stage sheets while the fade plays
+                    ui.preload_spritesheet(CurrentStage.bg_up)
+                    ui.preload_spritesheet(CurrentStage.bg_down)
+                    ui.preload_spritesheet(SpriteSheets['tilemap.sunny.1'])
                 end
             end
 
-            local ff = ping_pong(current_frame // 8, 5)
             local world_tiles = SpriteSheets['tilemap.world.1']
-            local props_tiles = SpriteSheets['tilemap.wprops.' .. ff]
+            local props_tiles = SpriteSheets['tilemap.wprops.1']
 
             draw_layer(current_frame, kMapID.tile, world_tiles)
             draw_layer(current_frame, kMapID.overlay, props_tiles)
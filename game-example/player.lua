@@ -16,6 +16,7 @@ function make_player(map_ref)
     local on_ground = false
     local win_frame = 0
     local tileset = nil
+    local body = map_ref.body { width = size.w, height = size.h, gravity = kGravity, max_fall = kMaxGravity }
 
     local function action_button_is(kind)
         if kind == kState.press then
@@ -27,44 +28,19 @@ function make_player(map_ref)
         end
     end
 
-    local function check_v_colisions()
-        if map_ref.colides(position.x + size.w / 2 - 4, position.y + size.h, kColisionType.bottom)
-            or map_ref.colides(position.x + size.w / 2 + 4, position.y + size.h, kColisionType.bottom) then
-            if velocity.y > 0 then
-                position.y = (((position.y + size.h) // 16) * 16) - size.h - 0.001
-                velocity.y = 0
-                on_ground = true
-            end
-        elseif map_ref.colides(position.x + size.w / 2 - 4, position.y + 12, kColisionType.top)
-            or map_ref.colides(position.x + size.w / 2 + 4, position.y + 12, kColisionType.top) then
-            if velocity.y < 0 then
-                position.y = (((position.y + size.h) // 16) * 16) - (size.h - 4)
-                velocity.y = 0
-            end
-        end
-    end
+    -- sensors, gravity and landing are resolved natively in one call
+    local function move()
+        local contacts
+        position.x, position.y, velocity.x, velocity.y, contacts =
+            ui.body_step(body, position.x, position.y, velocity.x, velocity.y)
 
-    local function check_h_colisions()
-        -- two sensors, in front of me, to the right
-        if map_ref.colides(position.x + size.w - 6, position.y + size.h - 18, kColisionType.right)
-            or map_ref.colides(position.x + size.w - 6, position.y + size.h - 1, kColisionType.right) then
-            if velocity.x > 0 then
-                position.x = position.x // 1
-                velocity.x = 0
-                state = kPlayerStates.idle
-            end
-        elseif map_ref.colides(position.x + 6, position.y + size.h - 18, kColisionType.left)
-            or map_ref.colides(position.x + 6, position.y + size.h - 1, kColisionType.left) then
-            if velocity.x < 0 then
-                position.x = position.x // 1
-                velocity.x = 0
-                state = kPlayerStates.idle
-            end
-        end
+        if contacts & (CONTACT_LEFT | CONTACT_RIGHT) ~= 0 then state = kPlayerStates.idle end
+        if contacts & CONTACT_GROUND ~= 0 then on_ground = true end
     end
 
+    -- falling off the screen once dead, through the map
     local function apply_gravity()
-        position.y = dead and position.y + velocity.y * 0.6 or position.y + velocity.y
+        position.y = position.y + velocity.y * 0.6
         velocity.y = velocity.y > kMaxGravity and kMaxGravity or velocity.y + kGravity
     end
 
@@ -115,22 +91,17 @@ function make_player(map_ref)
             end
         end
 
-        if not dead then check_h_colisions() end
-        apply_gravity()
-        if not dead then
-            position.x = position.x + velocity.x
-            check_v_colisions()
+        if dead then
+            apply_gravity()
+        else
+            move()
         end
     end
 
+    local rect = ui.box()
     local function box()
         local cfactor = (state == kPlayerStates.crouch) and 14 or 6
-        return {
-            x = math.floor(position.x + 0.5) + 8,
-            y = math.floor(position.y + 0.5) + cfactor,
-            width = 32 - 16,
-            height = 32 - cfactor
-        }
+        return rect:set(math.floor(position.x + 0.5) + 8, math.floor(position.y + 0.5) + cfactor, 32 - 16, 32 - cfactor)
     end
 
     local function draw(frame, camera, player)
@@ -3,25 +3,21 @@ function draw_box(box, camera)
     ui.draw_rect(box.x - camx, box.y - camy, box.x - camx + box.width, box.y - camy + box.height, false, 4)
 end
 
+-- boxes are ui.box userdata, updated in place instead of rebuilt per call
 function check_collision(a, b)
-    return a.x < b.x + b.width and
-        a.x + a.width > b.x and
-        a.y < b.y + b.height and
-        a.y + a.height > b.y
+    return a:overlaps(b)
 end
 
 local function make_spike(data)
+    local rect = ui.box((data.x - 1) * 16, (data.y - 1) * 16 + 6, 16, 10)
+
     local function box()
-        return {
-            x = (data.x - 1) * 16,
-            y = (data.y - 1) * 16 + 6,
-            width = 16,
-            height = 10
-        }
+        return rect
     end
 
     return {
         box = box,
+        bounds = box,
         update_relative_position = function() return true end,
         before_frame = function(frame, player, map, camera)
             if player and check_collision(box(), player.box()) then
@@ -39,13 +35,10 @@ local function make_spring(data)
     local jump_frames = 0
     local tileset = SpriteSheets["poi.spring.1"]
 
+    local rect = ui.box((spring.x - 1) * 16, (spring.y - 1) * 16, 16, 16)
+
     local function box()
-        return {
-            x = (spring.x - 1) * 16,
-            y = (spring.y - 1) * 16,
-            width = 16,
-            height = 16
-        }
+        return rect
     end
 
     local function update_relative_position(camx, camy)
@@ -54,6 +47,7 @@ local function make_spring(data)
     end
 
     return {
+        bounds = box,
         update_relative_position = update_relative_position,
         before_frame = function(frame, player, map, camera)
             jump_frames = math.max(jump_frames - 1, 0)
@@ -69,70 +63,46 @@ local function make_spring(data)
     }
 end
 
-local function make_beetle(beetle)
+local function make_beetle(beetle, map)
     local tx, ty = (beetle.x - 1) * 16, (beetle.y - 1) * 16
     local rx, ry
     local bx = 0
     local acell = 0.4
     local dead = 0
     local tileset = nil
+    -- only its side sensors are used: at the front edge, 8px below the top
+    local walls = map.body { width = 32, height = 9, side_inset = 0, side_reach = 1 }
 
-    local smoke = (function()
-        local out = {}
-        for i = 1, 30, 1 do
-            table.insert(out, { x = 0, y = 0, life = 0 })
-        end
-        return out
-    end)()
+    -- a puff every 10 frames that shrinks away over 150 frames
+    local smoke = ui.emitter { rate = 0.1, size = 6, shrink = 0.04, spread_y = 6, colors = { 23 }, max = 30 }
 
     local draw_smoke = function(camx, camy, frame)
-        for _, v in ipairs(smoke) do
-            if v.life > 0 then
-                ui.circfill((v.x - camx) // 1, (v.y - camy) // 1,
-                    math.floor(v.life + 0.5), 23)
-                v.life = v.life - 0.04
-            end
-        end
+        ui.emitter_draw(smoke, camx, camy)
     end
 
     local make_smoke = function(frame)
-        if frame % 10 ~= 0 then return end
-
-        for _, v in ipairs(smoke) do
-            if v.life <= 0 then
-                v.life = 6
-                v.x = tx + bx + (acell > 0 and 8 or 20)
-                v.y = ty + 16 + math.random(6)
-                return
-            end
-        end
+        ui.emitter_at(smoke, tx + bx + (acell > 0 and 8 or 20), ty + 17)
     end
 
+    local rect, view_rect = ui.box(), ui.box()
     local box = function()
-        return {
-            x = tx + bx // 1 + 6,
-            y = ty + 14,
-            width = 32 - 12,
-            height = 32 - 18
-        }
+        return rect:set(tx + bx // 1 + 6, ty + 14, 32 - 12, 32 - 18)
+    end
+
+    local bounds = function()
+        return view_rect:set(tx + bx // 1, ty, 32, 32)
     end
 
     local function update_relative_position(camx, camy, map)
-        if acell > 0 then
-            local ix = (tx + bx // 1 + 32)
-            local iy = (ty + 8)
-            if map.colides(ix, iy, kColisionType.right) then acell = acell * -1 end
-        else
-            local ix = (tx + bx // 1)
-            local iy = (ty + 8)
-            if map.colides(ix, iy, kColisionType.left) then acell = acell * -1 end
-        end
+        local _, _, _, _, contacts = ui.body_step(walls, tx + bx // 1, ty, acell, 0)
+        if contacts & (CONTACT_LEFT | CONTACT_RIGHT) ~= 0 then acell = acell * -1 end
 
         rx, ry = tx - camx + bx // 1, ty - camy
         return (rx < 480 and rx > -32) and (ry < 270 and ry > -32)
     end
 
     return {
+        bounds = bounds,
         update_relative_position = update_relative_position,
         faraway = function() dead = 0 end,
         before_frame = function(frame, player, map, camera)
@@ -181,13 +151,13 @@ local function make_bird(bird)
     local by, oby = 0, 0
     local dead = 0
     local tileset = nil
+    local rect, view_rect = ui.box(), ui.box()
     local box = function()
-        return {
-            x = tx + 6,
-            y = ty + by // 1 + 14,
-            width = 32 - 12,
-            height = 32 - 18
-        }
+        return rect:set(tx + 6, ty + by // 1 + 14, 32 - 12, 32 - 18)
+    end
+
+    local bounds = function()
+        return view_rect:set(tx, ty + by // 1, 32, 32)
     end
 
     local function update_relative_position(camx, camy)
@@ -196,6 +166,7 @@ local function make_bird(bird)
     end
 
     return {
+        bounds = bounds,
         update_relative_position = update_relative_position,
         faraway = function() end,
         before_frame = function(frame, player, map, camera)
@@ -241,6 +212,7 @@ end
 local function make_decal(decal, name, width_tiles, height_tiles)
     local rx, ry
     local sprite_name = SpriteSheets['poi.' .. name .. '.1']
+    local view_rect = ui.box((decal.x - 1) * 16, (decal.y - 8) * 16, 32 * width_tiles, 32 * height_tiles)
 
     local function update_relative_position(camx, camy)
         rx, ry = ((decal.x - 1) * 16) - camx, ((decal.y - 8) * 16) - camy
@@ -248,6 +220,7 @@ local function make_decal(decal, name, width_tiles, height_tiles)
     end
 
     return {
+        bounds = function() return view_rect end,
         update_relative_position = update_relative_position,
         before_frame = function(frame, player, map, camera)
 
@@ -263,13 +236,10 @@ local function make_cherry(cherry)
     local rx, ry
     local tileset = nil
 
+    local rect = ui.box((cherry.x - 1) * 16, (cherry.y - 1) * 16 + 2, 16, 16)
+    local view_rect = ui.box(cherry.x * 16 - 22, cherry.y * 16 - 22, 32, 32)
     local box = function()
-        return {
-            x = (cherry.x - 1) * 16,
-            y = (cherry.y - 1) * 16 + 2,
-            width = 16,
-            height = 16
-        }
+        return rect
     end
 
     local function update_relative_position(camx, camy)
@@ -285,6 +255,7 @@ local function make_cherry(cherry)
     end
 
     return {
+        bounds = function() return view_rect end,
         update_relative_position = update_relative_position,
         before_frame = function(frame, player, map, camera)
             if taken == 0 then
@@ -304,7 +275,7 @@ end
 local function make_poi_by_type(data, camera, player, map)
     if data.poi == kPoiType.spike then return make_spike(data) end
     if data.poi == kPoiType.spring then return make_spring(data) end
-    if data.poi == kPoiType.beetle then return make_beetle(data) end
+    if data.poi == kPoiType.beetle then return make_beetle(data, map) end
     if data.poi == kPoiType.palm then return make_decal(data, 'palm', 2, 4) end
     if data.poi == kPoiType.pine then return make_decal(data, 'pine', 2, 4) end
     if data.poi == kPoiType.house then return make_decal(data, 'house', 3, 3) end
@@ -319,29 +290,56 @@ end
 
 function make_pois(camera, player, map)
     local all_pois = {}
+    -- POIs register where they draw; each frame only those in view are visited
+    local grid = ui.spatial(16)
     for _, poi in ipairs(map.get_pois()) do
         local created = make_poi_by_type(poi, camera, player, map)
-        if created then table.insert(all_pois, created) end
+        if created then
+            table.insert(all_pois, created)
+            ui.spatial_set(grid, #all_pois, created.bounds())
+        end
     end
 
+    local view = ui.box(0, 0, 480, 270)
+    local visible, last_visible = {}, {}
+    local visible_count, last_count = 0, 0
+
     return {
         before_frame = function(frame, camera, player, map)
             local player = player.is_dead() == false and player or nil
             local camx, camy = camera.getxy()
 
-            for _, poi in ipairs(all_pois) do
+            visible, last_visible = last_visible, visible
+            last_count = visible_count
+            visible_count = ui.spatial_query(grid, view:set(camx, camy, 480, 270), visible)
+
+            for i = 1, visible_count do
+                local poi = all_pois[visible[i]]
+                poi.seen = frame
                 poi.will_draw = poi.update_relative_position(camx, camy, map)
                 if poi.will_draw then
                     poi.before_frame(frame, player, map, camera)
+                    -- enemies move while in view
+                    ui.spatial_set(grid, visible[i], poi.bounds())
                 elseif poi.faraway then
                     poi.faraway()
                 end
             end
+
+            -- POIs that just left the view
+            for i = 1, last_count do
+                local poi = all_pois[last_visible[i]]
+                if poi.seen ~= frame then
+                    poi.will_draw = false
+                    if poi.faraway then poi.faraway() end
+                end
+            end
         end,
         on_frame = function(frame, camera, player, map)
             local player = player.is_dead() == false and player or nil
 
-            for _, poi in ipairs(all_pois) do
+            for i = 1, visible_count do
+                local poi = all_pois[visible[i]]
                 if poi.will_draw then
                     poi.on_frame(frame, player, map, camera)
                 end
@@ -1,5 +1,18 @@
 function make_title()
     local move_to_next = 0
+    local background = nil
+
+    local function record_background()
+        background = ui.begin_list()
+        for x = 0, 21, 1 do
+            for y = 0, 12, 1 do
+                local next_radius = ((x + y) % 2 == 0) and 8 or 4
+                ui.draw_circle(x * 16, y * 16 + 8, next_radius, true, 32, false, 0)
+            end
+        end
+        ui.end_list()
+    end
+
     return {
         name = function() return "title" end,
         update = function() end,
@@ -27,17 +40,8 @@ function make_title()
             ui.preload_spritesheet(SpriteSheets['poi_cherry_' .. 1 + (frame // 4) % 7])
             ui.draw_rect(0, 0, 480, 270, true, 31, false, 0)
 
-            local delta = (current_frame // 2) % 32
-            for x = 0, 21, 1 do
-                for y = 0, 12, 1 do
-                    local next_x = x * 16
-                    local next_y = y * 16 + 8 - delta
-                    local next_radius = ((x + y) % 2 == 0) and 8 or 4
-                    if next_y >= -16 and next_y < 270 + 16 then
-                        ui.draw_circle(next_x, next_y, next_radius, true, 32, false, 0)
-                    end
-                end
-            end
+            if background == nil then record_background() end
+            ui.call_list(background, 0, -((current_frame // 2) % 32))
 
             ui.draw_rect(22, 22, 302, 162, true, 8, false, 0)
             ui.draw_rect(20, 20, 300, 160, true, 7, false, 0)
@@ -0,0 +1,75 @@
+#!/usr/bin/env lua5.4
+
+-- Precompiles every module under a source directory to bytecode:
+--   lua5.4 compile_bytecode.lua <source dir> <output dir> [--strip]
+--
+-- --strip drops debug info, so errors and sys.alloc_report() lose their file
+-- and line; the Makefile only passes it for production, which keeps its own
+-- output dir.
+--
+-- Each <output dir>/<module>.luac holds "LUPC", the FNV-1a hash of the source
+-- (u32 little-endian) and the string.dump() of the chunk. The runtime only
+-- uses it while the hash still matches the source next to it (src/bytecode.c).
+-- Bytecode is tied to the Lua version, so this must run on Lua 5.4 like the
+-- engine.
+
+if _VERSION ~= "Lua 5.4" then
+    error("compile_bytecode.lua needs Lua 5.4 to match the engine, got " .. _VERSION)
+end
+
+local MAGIC = "LUPC"
+
+local function read_file(path)
+    local file = io.open(path, "rb")
+    if not file then return nil end
+    local content = file:read("a")
+    file:close()
+    return content
+end
+
+local function shell_quote(s)
+    return "'" .. s:gsub("'", "'\\''") .. "'"
+end
+
+local function fnv1a(content)
+    local hash = 0x811C9DC5
+    for i = 1, #content do
+        hash = ((hash ~ content:byte(i)) * 0x01000193) & 0xFFFFFFFF
+    end
+    return hash
+end
+
+local source_path, output_path, strip_flag = arg[1], arg[2], arg[3]
+if not source_path or not output_path or (strip_flag and strip_flag ~= "--strip") then
+    print("usage: lua5.4 compile_bytecode.lua <source dir> <output dir> [--strip]")
+    os.exit(1)
+end
+local strip = strip_flag == "--strip"
+
+local pipe = io.popen("cd " .. shell_quote(source_path) .. " && find . -name '*.lua' -type f")
+local compiled, skipped = 0, 0
+
+for rel in pipe:lines() do
+    rel = rel:gsub("^%./", "")
+    local source = assert(read_file(source_path .. "/" .. rel))
+    local header = MAGIC .. string.pack("<I4", fnv1a(source))
+    local destination = output_path .. "/" .. rel .. "c"
+
+    local existing = read_file(destination)
+    if existing and existing:sub(1, #header) == header then
+        skipped = skipped + 1
+    else
+        local chunk = assert(load(source, "@" .. rel))
+        local dir = destination:match("(.+)/[^/]+$")
+        os.execute("mkdir -p " .. shell_quote(dir))
+
+        local file = assert(io.open(destination .. ".tmp", "wb"))
+        file:write(header, string.dump(chunk, strip))
+        file:close()
+        assert(os.rename(destination .. ".tmp", destination))
+        compiled = compiled + 1
+    end
+end
+
+pipe:close()
+print(string.format("[compile_bytecode] %d compiled, %d up to date", compiled, skipped))
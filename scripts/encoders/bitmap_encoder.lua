@@ -191,7 +191,13 @@ local function encode_bitmap(image_pixels)
     local w, h = #image_pixels[1], #image_pixels
     local magic_gray = 8456 -- 0x424242 in RGB555
     local base_tile_width, base_tile_height = find_base_tile_sizing(image_pixels, magic_gray)
-    local encoded_builder = ""
+    local encoded_builder = {}
+
+    -- first palette entry wins when a color is listed twice
+    local palette_index = {}
+    for i = #palette, 1, -1 do
+        palette_index[palette[i]] = i
+    end
 
     -- Iterate over the image in tiles
     for tile_y = 0, math.floor(h / base_tile_height) - 1 do
@@ -202,22 +208,16 @@ local function encode_bitmap(image_pixels)
                 for row = 1, base_tile_height do
                     for col = 1, base_tile_width do
                         local color = image_pixels[tile_y * base_tile_height + row][tile_x * base_tile_width + col]
-                        local index = 1
-
-                        for i, c in ipairs(palette) do
-                            if c == color then
-                                index = i
-                                break
-                            end
-                        end
-                        encoded_builder = encoded_builder .. string.char(index - 1)
+                        local index = palette_index[color] or 1
+
+                        encoded_builder[#encoded_builder + 1] = string.char(index - 1)
                     end
                 end
             end
         end
     end
 
-    return encoded_builder, base_tile_width, base_tile_height
+    return table.concat(encoded_builder), base_tile_width, base_tile_height
 end
 
 
@@ -332,21 +332,31 @@ local function do_palette_review(can_use_current_palette, unique_colors, missing
     end
 end
 
-return function(props)
-    local file_name, path, root_path = props.file_name, props.path, props.root_path
-
-    local image_pixels = file_to_pixels(path)
+-- Indexes already decoded pixels against the palette at root_path, growing it if needed
+local function encode_pixels(image_pixels, root_path)
     local unique_colors = pixels_to_unique_colors(image_pixels)
 
     local palette_path = root_path .. "/palette"
     local can_use_current_palette, missing_colors = load_and_check_current_palette(palette_path, unique_colors)
     do_palette_review(can_use_current_palette, unique_colors, missing_colors, palette_path)
 
-    local sh, sw = 0, 0
-    props.octet_content, sw, sh = encode_bitmap(image_pixels)
-    props.sendable = #props.octet_content > 0
-    props.extra_headers = {
-        ["x-tw"] = sw,
-        ["x-th"] = sh
-    }
+    return encode_bitmap(image_pixels)
 end
+
+-- The PNG decode is the slow part, so it can run on its own (see to_lupi.lua workers)
+return setmetatable({
+    decode = file_to_pixels,
+    encode = encode_pixels
+}, {
+    __call = function(_, props)
+        local file_name, path, root_path = props.file_name, props.path, props.root_path
+
+        local sh, sw = 0, 0
+        props.octet_content, sw, sh = encode_pixels(file_to_pixels(path), root_path)
+        props.sendable = #props.octet_content > 0
+        props.extra_headers = {
+            ["x-tw"] = sw,
+            ["x-th"] = sh
+        }
+    end
+})
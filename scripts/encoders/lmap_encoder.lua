@@ -0,0 +1,96 @@
+local bit = require("bit")
+
+-- Binary map (.lmap) read by src/mapfile.c, all values little-endian:
+--   "LMAP", u16 version, u16 width, u16 height, u16 layers, u16 chunk_size, u16 reserved
+--   chunk table, row-major: u32 offset, u32 length
+--   per chunk, per layer: (u16 count, u16 value) runs over chunk_size^2 cells, row-major
+local VERSION = 1
+local LAYERS = 4
+local CHUNK_SIZE = 16
+local HEADER_SIZE = 16
+
+local function u16(value)
+    if value < 0 or value > 0xFFFF then
+        error("Map value does not fit in 16 bits: " .. value)
+    end
+    return string.char(value % 256, math.floor(value / 256))
+end
+
+local function u32(value)
+    return string.char(
+        value % 256,
+        math.floor(value / 0x100) % 256,
+        math.floor(value / 0x10000) % 256,
+        math.floor(value / 0x1000000) % 256
+    )
+end
+
+-- Same cells the Lua table output keeps: those with a tile or a poi. The Lua
+-- table writer turns an empty tile into the string "nil", hence tonumber
+local function cell_layers(cell)
+    local t = tonumber(cell.t) or 0
+    local poi_id = cell.p and bit.band(cell.p, 0x3FF) or 0
+
+    if bit.band(t, 0x3FF) ~= 0 or poi_id ~= 0 then
+        return { t, cell.c or 0, cell.p or 0, cell.o or 0 }
+    end
+end
+
+local function encode_runs(values, builder)
+    local count, current = 0, values[1]
+    for i = 1, #values + 1 do
+        local value = values[i]
+        if value == current and count < 0xFFFF then
+            count = count + 1
+        else
+            builder[#builder + 1] = u16(count) .. u16(current)
+            count, current = 1, value
+        end
+    end
+end
+
+return function(lua_table)
+    local height, width, grid = #lua_table, 0, {}
+
+    for y, row in ipairs(lua_table) do
+        grid[y] = {}
+        for x, cell in ipairs(row) do
+            local layers = cell_layers(cell)
+            if layers then
+                grid[y][x] = layers
+                if x > width then width = x end
+            end
+        end
+    end
+
+    local chunks_x = math.ceil(width / CHUNK_SIZE)
+    local chunks_y = math.ceil(height / CHUNK_SIZE)
+    local table_entries, payloads = {}, {}
+    local offset = HEADER_SIZE + chunks_x * chunks_y * 8
+
+    for cy = 0, chunks_y - 1 do
+        for cx = 0, chunks_x - 1 do
+            local builder = {}
+
+            for layer = 1, LAYERS do
+                local values = {}
+                for ty = 1, CHUNK_SIZE do
+                    for tx = 1, CHUNK_SIZE do
+                        local row = grid[cy * CHUNK_SIZE + ty]
+                        local layers = row and row[cx * CHUNK_SIZE + tx]
+                        values[#values + 1] = layers and layers[layer] or 0
+                    end
+                end
+                encode_runs(values, builder)
+            end
+
+            local payload = table.concat(builder)
+            table_entries[#table_entries + 1] = u32(offset) .. u32(#payload)
+            payloads[#payloads + 1] = payload
+            offset = offset + #payload
+        end
+    end
+
+    return "LMAP" .. u16(VERSION) .. u16(width) .. u16(height) .. u16(LAYERS) .. u16(CHUNK_SIZE) .. u16(0)
+        .. table.concat(table_entries) .. table.concat(payloads)
+end
@@ -4,10 +4,13 @@ local bit = require("bit")
 local function tiled_id_to_lupi_id(gid)
     local flipped_horizontally  = bit.band(gid, 0x80000000) ~= 0
     local flipped_vertically    = bit.band(gid, 0x40000000) ~= 0
+    local flipped_diagonally    = bit.band(gid, 0x20000000) ~= 0
     local tile_id               = bit.band(gid, 0x1FFFFFFF)
 
-    -- lupi id is 10 bits for tile, 1 bit for flip x and 1 bit for flip y
+    -- lupi id is 10 bits for tile, 1 bit for flip x, 1 bit for flip y and
+    -- 1 bit for the x/y swap Tiled uses (with the flips) to rotate tiles
     return (tile_id % 112) + (flipped_horizontally and 1024 or 0) + (flipped_vertically and 2048 or 0)
+        + (flipped_diagonally and 4096 or 0)
 end
 
 local function encode_tiled_to_lua(content)
@@ -103,6 +106,7 @@ return function(props)
 
     local lua_table = encode_tiled_to_lua(content)
     local lua_table_string = generate_lua_table_string(lua_table)
+    props.map_table = lua_table
     props.octet_content = lua_table_string
     props.sendable = true
     props.type = "lua_code"
@@ -4,63 +4,344 @@ local uv = require("luv")
 local argparse = require("argparse")
 local tiled_encoder = require("encoders.lua_from_tiled_encoder")
 local bitmap_encoder = require("encoders.bitmap_encoder")
+local lmap_encoder = require("encoders.lmap_encoder")
 
 require("utils.table.dump")
 
-local SpriteSheets = {}
+local CACHE_DIR = ".lupi_cache"
+
+local function read_file(path, mode)
+    local file = io.open(path, mode or "r")
+    if not file then return nil end
+    local content = file:read("*all")
+    file:close()
+    return content
+end
+
+-- Writes through a temporary file so an interrupted run never leaves half a file behind
+local function write_file(path, content, mode)
+    local file = assert(io.open(path .. ".tmp", mode or "w"))
+    file:write(content)
+    file:close()
+    assert(os.rename(path .. ".tmp", path))
+end
+
+local function shell_quote(s)
+    return "'" .. s:gsub("'", "'\\''") .. "'"
+end
+
+--------------------------------------------------------------------------------
+-- Pixel intermediates: decoded PNGs as 16-bit BGR555 values, row by row
+--------------------------------------------------------------------------------
+local function pixels_to_string(rows)
+    local out = { #rows[1] .. " " .. #rows .. "\n" }
+    for _, row in ipairs(rows) do
+        for _, color in ipairs(row) do
+            out[#out + 1] = string.char(color % 256, math.floor(color / 256))
+        end
+    end
+    return table.concat(out)
+end
+
+local function string_to_pixels(content)
+    local w, h, header = content:match("^(%d+) (%d+)\n()")
+    w, h = tonumber(w), tonumber(h)
 
-local function encode_all_files(path)
-    local req = uv.fs_scandir(path)
+    local rows, pos = {}, header
+    for y = 1, h do
+        local row = {}
+        for x = 1, w do
+            local lo, hi = content:byte(pos, pos + 1)
+            row[x] = lo + hi * 256
+            pos = pos + 2
+        end
+        rows[y] = row
+    end
+    return rows
+end
+
+--------------------------------------------------------------------------------
+-- Worker mode: to_lupi.lua --worker <png|tmj> <input> <output>
+-- Runs one independent conversion in its own process
+--------------------------------------------------------------------------------
+if arg[1] == "--worker" then
+    local kind, input, output = arg[2], arg[3], arg[4]
+
+    if kind == "png" then
+        write_file(output, pixels_to_string(bitmap_encoder.decode(input)), "wb")
+    elseif kind == "tmj" then
+        local props = { file_name = input:match("[^/]+$"), path = input }
+        tiled_encoder(props)
+        write_file(output .. ".lmap", lmap_encoder(props.map_table), "wb")
+        write_file(output, props.octet_content)
+    else
+        error("unknown worker kind: " .. tostring(kind))
+    end
+
+    os.exit(0)
+end
+
+--------------------------------------------------------------------------------
+-- Source tree and content hashes
+--------------------------------------------------------------------------------
+local function list_files(root, relative, files)
+    files = files or {}
+    local req = uv.fs_scandir(relative and (root .. "/" .. relative) or root)
     while true do
         local name, type = uv.fs_scandir_next(req)
         if not name then break end
-        local fullpath = path .. '/' .. name
+        local rel = relative and (relative .. "/" .. name) or name
         if type == "directory" then
-            encode_all_files(fullpath)
+            if name ~= CACHE_DIR then list_files(root, rel, files) end
         else
-            local props = {
-                file_name = name,
-                path = fullpath,
-                root_path = to_path
-            }
-
-            if name:match("%.tmj$") then
-                tiled_encoder(props)
-
-                local new_file_name = name:gsub("%.tmj$", ".lua")
-                local file = io.open(to_path .. "/" .. new_file_name, "w")
-                file:write(props.octet_content)
-                file:close()
-            end
+            files[#files + 1] = rel
+        end
+    end
+    return files
+end
 
-            if name:match("%.png$") then
-                bitmap_encoder(props)
+-- One sha1sum (or shasum on macOS) call for the whole tree
+local function hash_files(root, files)
+    local hashes = {}
+    if #files == 0 then return hashes end
 
-                SpriteSheets[name:gsub("%.png$", "")] = {
-                    name = name:gsub("%.png$", ""),
-                    data = props.octet_content,
-                    width = props.extra_headers["x-tw"],
-                    height = props.extra_headers["x-th"],
-                    ntiles = props.octet_content:len() / (props.extra_headers["x-tw"] * props.extra_headers["x-th"])
-                }
-            end
+    local quoted = {}
+    for i, rel in ipairs(files) do
+        quoted[i] = shell_quote(root .. "/" .. rel)
+    end
+    local list = table.concat(quoted, " ")
+
+    for _, tool in ipairs({ "sha1sum", "shasum" }) do
+        local pipe = io.popen(tool .. " " .. list .. " 2>/dev/null")
+        local output = pipe:read("*all")
+        pipe:close()
+
+        for hash, path in output:gmatch("(%x+) [ *]([^\n]+)") do
+            hashes[path:sub(#root + 2)] = hash
+        end
+
+        if next(hashes) then return hashes end
+    end
+
+    error("Neither sha1sum nor shasum is available to hash the assets")
+end
+
+--------------------------------------------------------------------------------
+-- Manifest: source hashes from the last run and the cached sheet encodings
+--------------------------------------------------------------------------------
+local function load_manifest(cache_path)
+    local ok, manifest = pcall(dofile, cache_path .. "/manifest.lua")
+    if ok and type(manifest) == "table" then
+        manifest.files = manifest.files or {}
+        manifest.sheets = manifest.sheets or {}
+        return manifest
+    end
+    return { files = {}, sheets = {} }
+end
+
+local function save_manifest(cache_path, manifest)
+    write_file(cache_path .. "/manifest.lua", "return " .. table.dump(manifest, -1, false))
+end
+
+--------------------------------------------------------------------------------
+-- Parallel workers
+--------------------------------------------------------------------------------
+local function run_workers(jobs, max_workers)
+    local interpreter, script = arg[-1] or "lua", arg[0]
+    local next_job, running, failed = 1, 0, {}
+
+    local function start_next()
+        if next_job > #jobs then return end
+        local job = jobs[next_job]
+        next_job = next_job + 1
+        running = running + 1
+
+        local handle
+        handle = uv.spawn(interpreter, {
+            args = { script, "--worker", job.kind, job.input, job.output },
+            stdio = { nil, 1, 2 }
+        }, function(code)
+            handle:close()
+            running = running - 1
+            if code ~= 0 then failed[#failed + 1] = job.input end
+            start_next()
+        end)
+
+        if not handle then
+            running = running - 1
+            failed[#failed + 1] = job.input
+            start_next()
         end
     end
+
+    for _ = 1, math.min(max_workers, #jobs) do
+        start_next()
+    end
+
+    uv.run()
+
+    if #failed > 0 then
+        error("Conversion failed for:\n  " .. table.concat(failed, "\n  "))
+    end
+end
+
+--------------------------------------------------------------------------------
+-- Sheet encoding, validated against the palette it was indexed with
+--------------------------------------------------------------------------------
+local function current_palette()
+    _G.Palette = nil
+    pcall(dofile, to_path .. "/palette.lua")
+    return _G.Palette or {}
+end
+
+-- Colors of the palette entries a sheet uses; the palette only ever grows at
+-- the end, so a sheet stays valid while this prefix is unchanged
+local function palette_key(palette, data)
+    local max_index = 0
+    for i = 1, #data do
+        local index = data:byte(i)
+        if index > max_index then max_index = index end
+    end
+
+    local colors = {}
+    for i = 1, max_index + 1 do
+        colors[i] = string.format("%04X", palette[i] or 0xFFFF)
+    end
+    return table.concat(colors)
 end
 
+local function encode_sheet(cache_path, hash, manifest)
+    local rows = string_to_pixels(read_file(cache_path .. "/" .. hash .. ".pix", "rb"))
+    local data, tw, th = bitmap_encoder.encode(rows, to_path)
+
+    write_file(cache_path .. "/" .. hash .. ".sheet", data, "wb")
+    manifest.sheets[hash] = { width = tw, height = th, palette = palette_key(current_palette(), data) }
+end
+
+--------------------------------------------------------------------------------
+-- Main
+--------------------------------------------------------------------------------
 local parser = argparse("to_lupi", "Convert Tiled maps to Lupi format")
 parser:option("-f, --from", "From path")
 parser:option("-t, --to", "To path")
+parser:option("-j, --jobs", "Parallel conversions", tostring(#(uv.cpu_info() or {}) > 0 and #uv.cpu_info() or 4))
+-- kept out of the output tree, which is packaged into the web build as-is
+parser:option("-c, --cache", "Cache path", CACHE_DIR)
 local args = parser:parse()
 
 from_path = args.from
 to_path = args.to
 
-os.execute("mkdir -p " .. to_path)
-os.execute("cp -r " .. from_path .. "/* " .. to_path)
+local cache_path = args.cache
+os.execute("mkdir -p " .. shell_quote(cache_path))
+
+local manifest = load_manifest(cache_path)
+if manifest.to ~= to_path then manifest.files = {} end
+manifest.to = to_path
+local files = list_files(from_path)
+table.sort(files)
+local hashes = hash_files(from_path, files)
+
+-- Copy what changed, and queue conversions whose intermediate isn't cached
+local jobs, copied = {}, 0
+for _, rel in ipairs(files) do
+    local hash = hashes[rel]
+    local destination = to_path .. "/" .. rel
 
-encode_all_files(to_path)
+    if manifest.files[rel] ~= hash or not uv.fs_stat(destination) then
+        os.execute("mkdir -p " .. shell_quote(destination:match("(.+)/[^/]+$") or to_path))
+        assert(uv.fs_copyfile(from_path .. "/" .. rel, destination))
+        copied = copied + 1
+    end
+
+    local kind = rel:match("%.(png)$") or rel:match("%.(tmj)$")
+    local intermediate = kind and (cache_path .. "/" .. hash .. (kind == "png" and ".pix" or ".map"))
+    local cached = kind and uv.fs_stat(intermediate) and (kind == "png" or uv.fs_stat(intermediate .. ".lmap"))
 
-local file = io.open(to_path .. "/sprites.lua", "w")
-file:write("SpriteSheets = " .. table.dump(SpriteSheets, -1, false))
-file:close()
+    if kind and not cached then
+        jobs[#jobs + 1] = { kind = kind, input = from_path .. "/" .. rel, output = intermediate }
+    end
+end
+
+print(string.format("[to_lupi] %d files, %d copied, %d to convert on %s workers", #files, copied, #jobs, args.jobs))
+run_workers(jobs, tonumber(args.jobs))
+
+-- Maps: regenerated from the cached encodings, as a Lua table and as a binary .lmap
+for _, rel in ipairs(files) do
+    if rel:match("%.tmj$") then
+        local name = rel:match("([^/]+)%.tmj$")
+        local intermediate = cache_path .. "/" .. hashes[rel] .. ".map"
+
+        for _, output in ipairs({ { ".lua", intermediate, "" }, { ".lmap", intermediate .. ".lmap", "b" } }) do
+            local extension, source, binary = output[1], output[2], output[3]
+            local content = read_file(source, "r" .. binary)
+            if read_file(to_path .. "/" .. name .. extension, "r" .. binary) ~= content then
+                write_file(to_path .. "/" .. name .. extension, content, "w" .. binary)
+            end
+        end
+    end
+end
+
+-- Sheets: indexing may grow or reset the palette, so repeat until every sheet
+-- matches the palette that ends up on disk
+local pngs = {}
+for _, rel in ipairs(files) do
+    if rel:match("%.png$") then pngs[#pngs + 1] = rel end
+end
+
+for pass = 1, 3 do
+    local palette, stale = current_palette(), 0
+
+    for _, rel in ipairs(pngs) do
+        local hash = hashes[rel]
+        local sheet = manifest.sheets[hash]
+        local data = sheet and read_file(cache_path .. "/" .. hash .. ".sheet", "rb")
+
+        if not data or palette_key(palette, data) ~= sheet.palette then
+            encode_sheet(cache_path, hash, manifest)
+            palette = current_palette()
+            stale = stale + 1
+        end
+    end
+
+    if stale == 0 then break end
+    if pass == 3 then error("Palette did not settle after 3 passes") end
+end
+
+local SpriteSheets = {}
+for _, rel in ipairs(pngs) do
+    local name = rel:match("([^/]+)%.png$")
+    local sheet = manifest.sheets[hashes[rel]]
+    local data = read_file(cache_path .. "/" .. hashes[rel] .. ".sheet", "rb")
+
+    SpriteSheets[name] = {
+        name = name,
+        data = data,
+        width = sheet.width,
+        height = sheet.height,
+        ntiles = data:len() / (sheet.width * sheet.height)
+    }
+end
+
+write_file(to_path .. "/sprites.lua", "SpriteSheets = " .. table.dump(SpriteSheets, -1, false))
+
+-- Forget intermediates no source file points at anymore
+local in_use, sheets = {}, {}
+manifest.files = {}
+for _, rel in ipairs(files) do
+    manifest.files[rel] = hashes[rel]
+    in_use[hashes[rel]] = true
+    sheets[hashes[rel]] = manifest.sheets[hashes[rel]]
+end
+manifest.sheets = sheets
+save_manifest(cache_path, manifest)
+
+local req = uv.fs_scandir(cache_path)
+while true do
+    local name = uv.fs_scandir_next(req)
+    if not name then break end
+    local hash = name:match("^(%x+)%.[%a.]+$")
+    if hash and not in_use[hash] then
+        os.remove(cache_path .. "/" .. name)
+    end
+end
@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "drawlist.h"
+#include "tilemap.h"
+#include "mapfile.h"
+#include "spatial.h"
+#include "particles.h"
+#include "body.h"
+#include "assets.h"
+
+/*
+Global vars
+*/
+int current_asset_group = 0;
+extern SpritesInMemory sprites_in_memory;
+extern Registry display_lists;
+
+#define MAX_ASSET_GROUPS 16
+#define ASSET_GROUP_NAME_LENGTH 32
+
+static char asset_group_names[MAX_ASSET_GROUPS][ASSET_GROUP_NAME_LENGTH];
+static int asset_group_count = 0;
+static bool pending_release[MAX_ASSET_GROUPS + 1];
+
+/**
+Asset Group Functions
+**/
+//----------------------------------------------------------------------------------
+// Returns the id of a named group, registering the name on first use.
+// Group 0 means "no group": assets in it live for the whole session.
+//----------------------------------------------------------------------------------
+int get_asset_group(const char *name) {
+    for (int i = 0; i < asset_group_count; i++) {
+        if (strcmp(asset_group_names[i], name) == 0) {
+            return i + 1;
+        }
+    }
+
+    if (asset_group_count >= MAX_ASSET_GROUPS) {
+        printf("Warning: too many asset groups, %s is not tracked\n", name);
+        return 0;
+    }
+
+    strncpy(asset_group_names[asset_group_count], name, ASSET_GROUP_NAME_LENGTH - 1);
+    asset_group_names[asset_group_count][ASSET_GROUP_NAME_LENGTH - 1] = '\0';
+    asset_group_count++;
+
+    return asset_group_count;
+}
+
+void begin_asset_group(const char *name) {
+    current_asset_group = get_asset_group(name);
+    pending_release[current_asset_group] = false;
+}
+
+//----------------------------------------------------------------------------------
+// The frame being built may still reference the group's textures and lists,
+// so the release only happens after it was drawn (see process_asset_releases)
+//----------------------------------------------------------------------------------
+void release_asset_group(const char *name) {
+    int group = get_asset_group(name);
+    if (group == 0) return;
+
+    pending_release[group] = true;
+
+    if (current_asset_group == group) {
+        current_asset_group = 0;
+    }
+}
+
+static void release_group_now(int group) {
+    int sheets = 0, maps = 0, lists = 0;
+
+    for (int i = 0; i < sprites_in_memory.count; i++) {
+        SpriteInMemory *sprite = sprites_in_memory.sprites[i];
+        if (sprite->group != group) continue;
+
+        // Derived sheets can't be rebuilt from SpriteSheets, keep their indices
+        if (sprite->derived) {
+            sprite_in_memory_unload(sprite);
+        } else {
+            sprite_in_memory_release(sprite);
+        }
+
+        sprite->group = 0;
+        sheets++;
+    }
+
+    for (int id = 1; id <= tile_maps.count; id++) {
+        TileMap *map = get_tilemap(id);
+        if (map != NULL && map->group == group) {
+            delete_tilemap(id);
+            maps++;
+        }
+    }
+
+    for (int id = 1; id <= display_lists.count; id++) {
+        DisplayList *list = get_display_list(id);
+        if (list != NULL && list->group == group) {
+            delete_display_list(id);
+            lists++;
+        }
+    }
+
+    for (int id = 1; id <= map_files.count; id++) {
+        MapFile *map = get_map_file(id);
+        if (map != NULL && map->group == group) {
+            close_map_file(id);
+            maps++;
+        }
+    }
+
+    for (int id = 1; id <= spatial_hashes.count; id++) {
+        SpatialHash *hash = get_spatial_hash(id);
+        if (hash != NULL && hash->group == group) {
+            delete_spatial_hash(id);
+        }
+    }
+
+    for (int id = 1; id <= particle_emitters.count; id++) {
+        ParticleEmitter *emitter = get_emitter(id);
+        if (emitter != NULL && emitter->group == group) {
+            delete_emitter(id);
+        }
+    }
+
+    for (int i = 0; i < MAX_BG_LAYERS; i++) {
+        if (bg_layers[i].tileset != NULL && bg_layers[i].group == group) {
+            clear_bg_layer(i);
+        }
+    }
+
+    for (int id = 1; id <= kinematic_bodies.count; id++) {
+        KinematicBody *body = get_body(id);
+        if (body != NULL && body->group == group) {
+            delete_body(id);
+        }
+    }
+
+    printf("Asset group %s released: %d sheets, %d maps, %d lists\n", asset_group_names[group - 1], sheets, maps, lists);
+}
+
+void process_asset_releases() {
+    for (int group = 1; group <= asset_group_count; group++) {
+        if (pending_release[group]) {
+            pending_release[group] = false;
+            release_group_now(group);
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------
+// Sheets join the group that draws them; a sheet used again by a later group
+// moves to it and is no longer released with the old one
+//----------------------------------------------------------------------------------
+void mark_asset_used(SpriteInMemory *sprite) {
+    if (sprite != NULL && current_asset_group != 0) {
+        sprite->group = current_asset_group;
+    }
+}
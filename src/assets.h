@@ -0,0 +1,16 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include "types.h"
+
+/*
+Asset Group Functions
+*/
+extern int current_asset_group;
+int get_asset_group(const char *name);
+void begin_asset_group(const char *name);
+void release_asset_group(const char *name);
+void process_asset_releases();
+void mark_asset_used(SpriteInMemory *sprite);
+
+#endif
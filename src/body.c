@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "drawlist.h"
+#include "body.h"
+#include "mapfile.h"
+#include "assets.h"
+#include "registry.h"
+
+/*
+Constants
+*/
+// Moves are swept one tile at a time up to this many tiles a frame
+#define BODY_MAX_SUBSTEPS 64
+
+/*
+Global vars
+*/
+Registry kinematic_bodies;
+
+/**
+Kinematic Body Functions
+**/
+int create_body(KinematicBody settings) {
+    KinematicBody *body = (KinematicBody *) malloc(sizeof(KinematicBody));
+    *body = settings;
+    body->group = current_asset_group;
+
+    return registry_add(&kinematic_bodies, body);
+}
+
+KinematicBody* get_body(int id) {
+    return (KinematicBody *) registry_get(&kinematic_bodies, id);
+}
+
+void delete_body(int id) {
+    KinematicBody *body = get_body(id);
+    if (body == NULL) return;
+
+    free(body);
+    registry_remove(&kinematic_bodies, id);
+}
+
+// Whether the collision tile under the point blocks the given side
+static bool body_solid_at(KinematicBody *body, MapFile *map, double x, double y, int side) {
+    if (map == NULL) return false;
+
+    uint16_t value = map_file_get(map, body->layer, (int) floor(x / body->tile_size), (int) floor(y / body->tile_size));
+    if (value == 0) return false;
+
+    for (int i = 0; i < body->solid_count; i++) {
+        if (body->solids[i].value == value) return (body->solids[i].sides & side) != 0;
+    }
+
+    return false;
+}
+
+// Stops movement into a wall on the side the body is moving towards
+static int body_resolve_side(KinematicBody *body, MapFile *map, double *x, double y, double *vx) {
+    double upper = y + body->height - body->side_reach;
+    double lower = y + body->height - 1;
+
+    if (*vx > 0) {
+        double right = *x + body->width - body->side_inset;
+        if (body_solid_at(body, map, right, upper, SOLID_RIGHT) || body_solid_at(body, map, right, lower, SOLID_RIGHT)) {
+            *x = floor(*x);
+            *vx = 0;
+            return CONTACT_RIGHT;
+        }
+    } else if (*vx < 0) {
+        double left = *x + body->side_inset;
+        if (body_solid_at(body, map, left, upper, SOLID_LEFT) || body_solid_at(body, map, left, lower, SOLID_LEFT)) {
+            *x = floor(*x);
+            *vx = 0;
+            return CONTACT_LEFT;
+        }
+    }
+
+    return 0;
+}
+
+// Lands the feet on tiles blocking their bottom, or stops the head under tiles blocking their top
+static int body_resolve_vertical(KinematicBody *body, MapFile *map, double x, double *y, double *vy) {
+    double h = body->height;
+    double foot_left = x + body->width / 2 - body->foot_inset;
+    double foot_right = x + body->width / 2 + body->foot_inset;
+    double row_top = floor((*y + h) / body->tile_size) * body->tile_size;
+
+    if (body_solid_at(body, map, foot_left, *y + h, SOLID_BOTTOM) || body_solid_at(body, map, foot_right, *y + h, SOLID_BOTTOM)) {
+        if (*vy > 0) {
+            *y = row_top - h - 0.001;
+            *vy = 0;
+            return CONTACT_GROUND;
+        }
+    } else if (body_solid_at(body, map, foot_left, *y + body->head, SOLID_TOP) || body_solid_at(body, map, foot_right, *y + body->head, SOLID_TOP)) {
+        if (*vy < 0) {
+            *y = row_top - (h - 4);
+            *vy = 0;
+            return CONTACT_CEILING;
+        }
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// One frame of movement for a width x height body at (x, y), resolved in place;
+// returns CONTACT_* flags. The move is swept in steps of at most one tile, so
+// fast bodies can't pass through floors and platforms. Before each step the
+// side sensors on the side the body is moving towards stop movement into a
+// wall; after it, feet land on tiles blocking their bottom, so a tile that
+// only blocks the bottom is a one-way platform.
+//----------------------------------------------------------------------------------
+int body_step(KinematicBody *body, double *x, double *y, double *vx, double *vy) {
+    MapFile *map = get_map_file(body->map_file);
+    int contacts = 0;
+
+    double distance = fabs(*vx) > fabs(*vy) ? fabs(*vx) : fabs(*vy);
+    int steps = (int) ceil(distance / body->tile_size);
+    if (!(steps >= 1)) steps = 1;
+    if (steps > BODY_MAX_SUBSTEPS) steps = BODY_MAX_SUBSTEPS;
+
+    double step_y = *vy / steps;
+    *vy = *vy > body->max_fall ? body->max_fall : *vy + body->gravity;
+
+    for (int i = 0; i < steps; i++) {
+        contacts |= body_resolve_side(body, map, x, *y, vx);
+        *y += step_y;
+        *x += *vx / steps;
+
+        // Landed or hit the head: the rest of the frame only moves sideways
+        int vertical = body_resolve_vertical(body, map, *x, y, vy);
+        if (vertical != 0) {
+            contacts |= vertical;
+            step_y = 0;
+        }
+    }
+
+    return contacts;
+}
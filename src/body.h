@@ -0,0 +1,15 @@
+#ifndef BODY_H
+#define BODY_H
+
+#include "types.h"
+
+/*
+Kinematic Body Functions
+*/
+extern Registry kinematic_bodies;
+int create_body(KinematicBody settings);
+KinematicBody* get_body(int id);
+void delete_body(int id);
+int body_step(KinematicBody *body, double *x, double *y, double *vx, double *vy);
+
+#endif
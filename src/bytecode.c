@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+#include "bytecode.h"
+
+/*
+Constants
+*/
+// Written by scripts/compile_bytecode.lua: "LUPC", u32 FNV-1a of the source, bytecode
+#define BYTECODE_DIR "bytecode/"
+#define BYTECODE_HEADER_SIZE 8
+
+/*
+Global vars
+*/
+int bytecode_chunks_loaded = 0;
+int source_chunks_loaded = 0;
+
+static char* read_whole_file(const char *path, long *size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *content = (char *) malloc(*size > 0 ? *size : 1);
+    if (fread(content, 1, *size, file) != (size_t) *size) {
+        free(content);
+        content = NULL;
+    }
+
+    fclose(file);
+    return content;
+}
+
+static uint32_t fnv1a(const char *bytes, long size) {
+    uint32_t hash = 0x811C9DC5u;
+    for (long i = 0; i < size; i++) {
+        hash = (hash ^ (unsigned char) bytes[i]) * 0x01000193u;
+    }
+    return hash;
+}
+
+/**
+Bytecode Cache Functions
+**/
+//----------------------------------------------------------------------------------
+// Loads the precompiled chunk for a source file when its hash still matches;
+// returns false, with the stack untouched, when it's missing or stale
+//----------------------------------------------------------------------------------
+static bool load_bytecode(lua_State *L, const char *path) {
+    if (strncmp(path, "./", 2) == 0) path += 2;
+
+    char bytecode_path[512];
+    if (snprintf(bytecode_path, sizeof(bytecode_path), "%s%sc", BYTECODE_DIR, path) >= (int) sizeof(bytecode_path)) return false;
+
+    long bytecode_size, source_size;
+    char *bytecode = read_whole_file(bytecode_path, &bytecode_size);
+    if (bytecode == NULL) return false;
+
+    char *source = read_whole_file(path, &source_size);
+    bool valid = source != NULL && bytecode_size > BYTECODE_HEADER_SIZE && memcmp(bytecode, "LUPC", 4) == 0;
+
+    if (valid) {
+        const unsigned char *hash = (const unsigned char *) bytecode + 4;
+        uint32_t stored = hash[0] | (hash[1] << 8) | (hash[2] << 16) | ((uint32_t) hash[3] << 24);
+        valid = stored == fnv1a(source, source_size);
+    }
+
+    if (valid) {
+        lua_pushfstring(L, "@%s", path);
+        valid = luaL_loadbufferx(L, bytecode + BYTECODE_HEADER_SIZE, bytecode_size - BYTECODE_HEADER_SIZE, lua_tostring(L, -1), "b") == LUA_OK;
+        lua_remove(L, -2);
+        if (!valid) lua_pop(L, 1);
+    }
+
+    free(source);
+    free(bytecode);
+    return valid;
+}
+
+//----------------------------------------------------------------------------------
+// Drop-in for luaL_loadfile() that prefers the bytecode cache
+//----------------------------------------------------------------------------------
+int load_lua_chunk(lua_State *L, const char *path) {
+    if (load_bytecode(L, path)) {
+        bytecode_chunks_loaded++;
+        return LUA_OK;
+    }
+
+    source_chunks_loaded++;
+    return luaL_loadfile(L, path);
+}
+
+//----------------------------------------------------------------------------------
+// package.searchers entry: resolves the module on package.path like the Lua
+// searcher, then loads it through load_lua_chunk()
+//----------------------------------------------------------------------------------
+static int bytecode_searcher(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "searchpath");
+    lua_pushvalue(L, 1);
+    lua_getfield(L, -3, "path");
+    lua_call(L, 2, 2);
+
+    // Not found: the reason why, as for the Lua searcher
+    if (lua_isnil(L, -2)) return 1;
+
+    const char *path = lua_tostring(L, -2);
+    if (load_lua_chunk(L, path) != LUA_OK) {
+        return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", name, path, lua_tostring(L, -1));
+    }
+
+    lua_pushstring(L, path);
+    return 2;
+}
+
+//----------------------------------------------------------------------------------
+// Runs ahead of the Lua file searcher, after package.preload
+//----------------------------------------------------------------------------------
+void install_bytecode_searcher(lua_State *L) {
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "searchers");
+
+    for (int i = (int) luaL_len(L, -1); i >= 2; i--) {
+        lua_rawgeti(L, -1, i);
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    lua_pushcfunction(L, bytecode_searcher);
+    lua_rawseti(L, -2, 2);
+
+    lua_pop(L, 2);
+}
@@ -0,0 +1,14 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <lua.h>
+
+/*
+Bytecode Cache Functions
+*/
+extern int bytecode_chunks_loaded;
+extern int source_chunks_loaded;
+int load_lua_chunk(lua_State *L, const char *path);
+void install_bytecode_searcher(lua_State *L);
+
+#endif
@@ -0,0 +1,184 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "drawlist.h"
+#include "decode.h"
+#include "expand.h"
+
+#ifdef LUPI_THREADS
+    #include <pthread.h>
+    #include <unistd.h>
+    #if defined(__EMSCRIPTEN__)
+        #include <emscripten/threading.h>
+    #endif
+#endif
+
+/*
+Constants
+*/
+// Jobs smaller than this are not worth handing to another thread
+#define DECODE_JOB_MIN_PIXELS (16 * 1024)
+// Set by the Makefile, which sizes Emscripten's PTHREAD_POOL_SIZE to the same
+// cores - 1 workers capped at this: threads beyond the pool only start once the
+// main thread yields, and the main thread blocks while sheets decode
+#ifndef DECODE_WORKERS
+#define DECODE_WORKERS 7
+#endif
+#define MAX_DECODE_WORKERS DECODE_WORKERS
+
+/*
+Global vars
+*/
+static DecodeJob *jobs = NULL;
+static int job_count = 0;
+static int job_max_count = 0;
+
+#ifdef LUPI_THREADS
+static pthread_t workers[MAX_DECODE_WORKERS];
+static int worker_count = 0;
+static pthread_mutex_t jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jobs_finished = PTHREAD_COND_INITIALIZER;
+static int next_job = 0;
+static int jobs_done = 0;
+#endif
+
+static void run_job(DecodeJob *job) {
+    sprite_in_memory_decode_tiles(job->sprite, job->pixels, job->first_tile, job->last_tile);
+}
+
+#ifdef LUPI_THREADS
+//----------------------------------------------------------------------------------
+// Takes the next job of the current batch; returns NULL when none is left.
+// Must be called with jobs_mutex held.
+//----------------------------------------------------------------------------------
+static DecodeJob* take_job() {
+    if (next_job >= job_count) return NULL;
+    return &jobs[next_job++];
+}
+
+static void finish_job() {
+    pthread_mutex_lock(&jobs_mutex);
+    jobs_done++;
+    if (jobs_done == job_count) {
+        pthread_cond_signal(&jobs_finished);
+    }
+    pthread_mutex_unlock(&jobs_mutex);
+}
+
+static void *decode_worker(void *arg) {
+    (void) arg;
+
+    for (;;) {
+        pthread_mutex_lock(&jobs_mutex);
+
+        DecodeJob *job;
+        while ((job = take_job()) == NULL) {
+            pthread_cond_wait(&jobs_ready, &jobs_mutex);
+        }
+
+        pthread_mutex_unlock(&jobs_mutex);
+
+        run_job(job);
+        finish_job();
+    }
+
+    return NULL;
+}
+#endif
+
+//----------------------------------------------------------------------------------
+// Starts one worker per extra core, up to MAX_DECODE_WORKERS. Without
+// LUPI_THREADS decoding stays on the calling thread and this does nothing.
+//----------------------------------------------------------------------------------
+void init_decode_workers() {
+#ifdef LUPI_THREADS
+    #if defined(__EMSCRIPTEN__)
+    int cores = emscripten_num_logical_cores();
+    #else
+    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    #endif
+
+    int wanted = cores - 1;
+    if (wanted > MAX_DECODE_WORKERS) wanted = MAX_DECODE_WORKERS;
+
+    for (int i = 0; i < wanted; i++) {
+        if (pthread_create(&workers[worker_count], NULL, decode_worker, NULL) != 0) break;
+        worker_count++;
+    }
+
+    printf("Decoding sheets on %d threads (%s)\n", worker_count + 1, expand_kernel_name());
+#endif
+}
+
+static void push_job(SpriteInMemory *sprite, Color *pixels, int first_tile, int last_tile) {
+    if (job_count >= job_max_count) {
+        job_max_count = job_max_count == 0 ? 32 : job_max_count * 2;
+        jobs = (DecodeJob *) realloc(jobs, sizeof(DecodeJob) * job_max_count);
+    }
+
+    jobs[job_count++] = (DecodeJob) { sprite, pixels, first_tile, last_tile };
+}
+
+//----------------------------------------------------------------------------------
+// Expands the index data of each sheet into pixels[i], an RGBA image of the
+// sheet's tile grid. Sheets are split into tile ranges shared by the workers
+// and the calling thread; returns once every sheet is decoded. GL uploads are
+// left to the caller, which must be the render thread.
+//----------------------------------------------------------------------------------
+void decode_sheets(SpriteInMemory **sheets, Color **pixels, int count) {
+#ifdef LUPI_THREADS
+    // Workers only look at the job list with the lock held
+    pthread_mutex_lock(&jobs_mutex);
+#endif
+
+    job_count = 0;
+
+    for (int i = 0; i < count; i++) {
+        SpriteInMemory *sprite = sheets[i];
+        int tile_pixels = sprite->tile_width * sprite->tile_height;
+        int tiles_per_job = tile_pixels >= DECODE_JOB_MIN_PIXELS ? 1 : DECODE_JOB_MIN_PIXELS / tile_pixels;
+
+        for (int first = 0; first < sprite->ntiles; first += tiles_per_job) {
+            int last = first + tiles_per_job;
+            if (last > sprite->ntiles) last = sprite->ntiles;
+
+            push_job(sprite, pixels[i], first, last);
+        }
+    }
+
+#ifdef LUPI_THREADS
+    if (worker_count > 0 && job_count > 1) {
+        next_job = 0;
+        jobs_done = 0;
+        pthread_cond_broadcast(&jobs_ready);
+
+        DecodeJob *job;
+        while ((job = take_job()) != NULL) {
+            pthread_mutex_unlock(&jobs_mutex);
+            run_job(job);
+            pthread_mutex_lock(&jobs_mutex);
+            jobs_done++;
+        }
+
+        while (jobs_done < job_count) {
+            pthread_cond_wait(&jobs_finished, &jobs_mutex);
+        }
+
+        job_count = 0;
+        next_job = 0;
+        pthread_mutex_unlock(&jobs_mutex);
+        return;
+    }
+#endif
+
+    for (int i = 0; i < job_count; i++) {
+        run_job(&jobs[i]);
+    }
+
+    job_count = 0;
+
+#ifdef LUPI_THREADS
+    pthread_mutex_unlock(&jobs_mutex);
+#endif
+}
@@ -0,0 +1,12 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include "types.h"
+
+/*
+Sheet Decoding Functions
+*/
+void init_decode_workers();
+void decode_sheets(SpriteInMemory **sheets, Color **pixels, int count);
+
+#endif
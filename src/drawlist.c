@@ -1,19 +1,42 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 
 #include "drawlist.h"
+#include "tilemap.h"
+#include "assets.h"
+#include "decode.h"
+#include "expand.h"
+#include "registry.h"
+#include "rlgl.h"
 
 /*
 Global vars
 */
 extern Drawlist drawlist;
 Color palette[PALETTE_SIZE];
+uint32_t palette_lut[PALETTE_SIZE];
+Registry display_lists;
+
+// Display list being recorded, if any; drawables go there instead of the frame
+static DisplayList *recording_list = NULL;
+
+static Drawlist* current_drawlist() {
+    return recording_list != NULL ? &recording_list->items : &drawlist;
+}
 
 /*
 Fill pattern
 */
 uint8_t fill_pattern[8] = {0, 0, 0, 0, 0, 0, 0, 0};
 
+bool has_fill_pattern(uint8_t pattern[8]) {
+    for (int i = 0; i < 8; i++) {
+        if (pattern[i] != 0) return true;
+    }
+    return false;
+}
+
 bool should_draw_pixel_with_pattern(int x, int y, uint8_t pattern[8]) {
     bool is_solid = true;
     for (int i = 0; i < 8; i++) {
@@ -59,44 +82,58 @@ void draw(NodeDrawable *node) {
         case 'w':
             draw_sprite((SpriteItem *) node->drawable);
             break;
+        case 'b':
+            draw_batch((BatchItem *) node->drawable);
+            break;
+        case 'd':
+            draw_call_list((CallListItem *) node->drawable);
+            break;
+        case 'm':
+            draw_chunk((ChunkItem *) node->drawable);
+            break;
     }
 }
 
-void clear_drawlist() {
-    NodeDrawable *current = drawlist.root;
+void free_drawlist(Drawlist *list) {
+    NodeDrawable *current = list->root;
     while(current != NULL) {
         NodeDrawable *next = current->next;
 
+        if (current->type == 'b') {
+            free(((BatchItem *) current->drawable)->vertices);
+        } else if (current->type == 't' && ((TextItem *) current->drawable)->owns_text) {
+            free(((TextItem *) current->drawable)->text);
+        }
+
         free(current->drawable);
         free(current);
         current = next;
     }
-    drawlist.count = 0;
-    drawlist.root = NULL;
+    list->count = 0;
+    list->root = NULL;
+    list->tail = NULL;
 }
 
-void add_drawable(void *drawable, char type) {
-    if(drawlist.count == 0) {
-        drawlist.count++;
-
-        NodeDrawable *node = (NodeDrawable *) malloc(sizeof(NodeDrawable));
-        drawlist.root = node;
-        node->drawable = drawable;
-        node->type = type;
-        node->next = NULL;
-        return;
-    }
-
-    drawlist.count++;
+void clear_drawlist() {
+    free_drawlist(&drawlist);
+}
 
-    NodeDrawable *current = drawlist.root;
-    for(; current->next != NULL; current = current->next) {}
+void add_drawable(void *drawable, char type) {
+    Drawlist *list = current_drawlist();
 
     NodeDrawable *node = (NodeDrawable *) malloc(sizeof(NodeDrawable));
-    current->next = node;
-    node->next = NULL;
     node->drawable = drawable;
     node->type = type;
+    node->next = NULL;
+
+    if(list->count == 0) {
+        list->root = node;
+    } else {
+        list->tail->next = node;
+    }
+
+    list->tail = node;
+    list->count++;
 }
 
 /**
@@ -104,12 +141,15 @@ Text Functions
 **/
 void add_text(char *text_s, int x, int y) {
     TextItem *text = (TextItem *) malloc(sizeof(TextItem));
-    text->text = text_s;
     text->x = x;
     text->y = y;
     text->fontSize = 20;
     text->color = DARKGRAY;
 
+    // Recorded lists outlive the Lua string, so they keep their own copy
+    text->owns_text = recording_list != NULL;
+    text->text = text->owns_text ? strdup(text_s) : text_s;
+
     add_drawable(text, 't');
 }
 
@@ -139,6 +179,11 @@ void draw_line(LineItem *line) {
 Rect Functions
 **/
 void add_rect(int x, int y, int width, int height, bool filled, Color color) {
+    if (filled && !has_fill_pattern(fill_pattern)) {
+        batch_add_quad(x, y, width, height, color);
+        return;
+    }
+
     RectItem *rect = (RectItem *) malloc(sizeof(RectItem));
     rect->x = x;
     rect->y = y;
@@ -153,15 +198,7 @@ void add_rect(int x, int y, int width, int height, bool filled, Color color) {
 
 void draw_rect(RectItem *rect) {
     if(rect->filled) {
-        bool has_pattern = false;
-        for (int i = 0; i < 8; i++) {
-            if (rect->fill_pattern[i] != 0) {
-                has_pattern = true;
-                break;
-            }
-        }
-
-        if (has_pattern) {
+        if (has_fill_pattern(rect->fill_pattern)) {
             for (int y = rect->y; y < rect->y + rect->height; y++) {
                 for (int x = rect->x; x < rect->x + rect->width; x++) {
                     if (should_draw_pixel_with_pattern(x, y, rect->fill_pattern)) {
@@ -181,6 +218,13 @@ void draw_rect(RectItem *rect) {
 Circle Functions
 **/
 void add_circle(int center_x, int center_y, int radius, bool filled, Color color, bool has_border, Color border_color) {
+    // A border of the fill color only widens the disc by the outline's half pixel
+    bool same_border = has_border && memcmp(&border_color, &color, sizeof(Color)) == 0;
+    if (filled && (!has_border || same_border) && !has_fill_pattern(fill_pattern)) {
+        batch_add_circle(center_x, center_y, same_border ? radius + 0.5f : radius, color);
+        return;
+    }
+
     CircleItem *circle = (CircleItem *) malloc(sizeof(CircleItem));
     circle->center_x = center_x;
     circle->center_y = center_y;
@@ -196,15 +240,7 @@ void add_circle(int center_x, int center_y, int radius, bool filled, Color color
 
 void draw_circle(CircleItem *circle) {
     if(circle->filled) {
-        bool has_pattern = false;
-        for (int i = 0; i < 8; i++) {
-            if (circle->fill_pattern[i] != 0) {
-                has_pattern = true;
-                break;
-            }
-        }
-
-        if (has_pattern) {
+        if (has_fill_pattern(circle->fill_pattern)) {
             int radius_squared = circle->radius * circle->radius;
             for (int y = circle->center_y - circle->radius; y <= circle->center_y + circle->radius; y++) {
                 for (int x = circle->center_x - circle->radius; x <= circle->center_x + circle->radius; x++) {
@@ -231,16 +267,11 @@ void draw_circle(CircleItem *circle) {
 Triangle Functions
 **/
 void add_triangle(int p1_x, int p1_y, int p2_x, int p2_y, int p3_x, int p3_y, Color color) {
-    TriangleItem *triangle = (TriangleItem *) malloc(sizeof(TriangleItem));
-    triangle->p1_x = p1_x;
-    triangle->p1_y = p1_y;
-    triangle->p2_x = p2_x;
-    triangle->p2_y = p2_y;
-    triangle->p3_x = p3_x;
-    triangle->p3_y = p3_y;
-    triangle->color = color;
-
-    add_drawable(triangle, 'v');
+    // Same winding as draw_triangle(), so culling keeps behaving the same
+    BatchItem *batch = batch_for_color(color, 3);
+    batch_push_vertex(batch, p1_x, p1_y);
+    batch_push_vertex(batch, p3_x, p3_y);
+    batch_push_vertex(batch, p2_x, p2_y);
 }
 
 void draw_triangle(TriangleItem *triangle) {
@@ -251,10 +282,216 @@ void draw_triangle(TriangleItem *triangle) {
     DrawTriangle(v1, v3, v2, triangle->color);
 }
 
+/**
+Batch Functions
+**/
+#define BATCH_CIRCLE_SEGMENTS 36
+
+BatchItem* batch_for_color(Color color, int extra_vertices) {
+    Drawlist *list = current_drawlist();
+    BatchItem *batch = NULL;
+
+    if (list->count > 0 && list->tail->type == 'b') {
+        batch = (BatchItem *) list->tail->drawable;
+        if (memcmp(&batch->color, &color, sizeof(Color)) != 0) {
+            batch = NULL;
+        }
+    }
+
+    if (batch == NULL) {
+        batch = (BatchItem *) malloc(sizeof(BatchItem));
+        batch->color = color;
+        batch->vertex_count = 0;
+        batch->max_vertex_count = 0;
+        batch->vertices = NULL;
+
+        add_drawable(batch, 'b');
+    }
+
+    if (batch->vertex_count + extra_vertices > batch->max_vertex_count) {
+        int max_vertex_count = batch->max_vertex_count == 0 ? 96 : batch->max_vertex_count;
+        while (batch->vertex_count + extra_vertices > max_vertex_count) {
+            max_vertex_count *= 2;
+        }
+
+        batch->vertices = (float *) realloc(batch->vertices, sizeof(float) * 2 * max_vertex_count);
+        batch->max_vertex_count = max_vertex_count;
+    }
+
+    return batch;
+}
+
+void batch_push_vertex(BatchItem *batch, float x, float y) {
+    batch->vertices[batch->vertex_count * 2] = x;
+    batch->vertices[batch->vertex_count * 2 + 1] = y;
+    batch->vertex_count++;
+}
+
+void batch_add_quad(int x, int y, int width, int height, Color color) {
+    BatchItem *batch = batch_for_color(color, 6);
+
+    // Same vertex order raylib uses for DrawRectangle()
+    batch_push_vertex(batch, x, y);
+    batch_push_vertex(batch, x, y + height);
+    batch_push_vertex(batch, x + width, y);
+
+    batch_push_vertex(batch, x + width, y);
+    batch_push_vertex(batch, x, y + height);
+    batch_push_vertex(batch, x + width, y + height);
+}
+
+void batch_add_circle(int center_x, int center_y, float radius, Color color) {
+    BatchItem *batch = batch_for_color(color, BATCH_CIRCLE_SEGMENTS * 3);
+
+    // Same fan raylib uses for DrawCircle()
+    float step = 360.0f / BATCH_CIRCLE_SEGMENTS;
+    for (int i = 0; i < BATCH_CIRCLE_SEGMENTS; i++) {
+        float angle = i * step;
+
+        batch_push_vertex(batch, center_x, center_y);
+        batch_push_vertex(batch, center_x + cosf(DEG2RAD * (angle + step)) * radius, center_y + sinf(DEG2RAD * (angle + step)) * radius);
+        batch_push_vertex(batch, center_x + cosf(DEG2RAD * angle) * radius, center_y + sinf(DEG2RAD * angle) * radius);
+    }
+}
+
+void draw_batch(BatchItem *batch) {
+    rlBegin(RL_TRIANGLES);
+    rlColor4ub(batch->color.r, batch->color.g, batch->color.b, batch->color.a);
+
+    for (int i = 0; i < batch->vertex_count; i++) {
+        rlVertex2f(batch->vertices[i * 2], batch->vertices[i * 2 + 1]);
+    }
+
+    rlEnd();
+}
+
+/**
+Display List Functions
+**/
+int begin_display_list() {
+    if (recording_list != NULL) return 0;
+
+    DisplayList *list = (DisplayList *) malloc(sizeof(DisplayList));
+    list->group = current_asset_group;
+    list->deleted = false;
+    list->items.count = 0;
+    list->items.root = NULL;
+    list->items.tail = NULL;
+
+    recording_list = list;
+
+    return registry_add(&display_lists, list);
+}
+
+void end_display_list() {
+    recording_list = NULL;
+}
+
+bool is_recording_display_list(DisplayList *list) {
+    return list != NULL && list == recording_list;
+}
+
+DisplayList* get_recording_display_list() {
+    return recording_list;
+}
+
+// Includes lists deleted this frame, which calls queued earlier still draw
+static DisplayList* display_list_slot(int id) {
+    return (DisplayList *) registry_get(&display_lists, id);
+}
+
+DisplayList* get_display_list(int id) {
+    DisplayList *list = display_list_slot(id);
+    return list != NULL && !list->deleted ? list : NULL;
+}
+
+//----------------------------------------------------------------------------------
+// Calls to the list may already be queued in this frame, so it is only freed
+// by end_display_list_frame() once the frame was drawn
+//----------------------------------------------------------------------------------
+void delete_display_list(int id) {
+    DisplayList *list = get_display_list(id);
+    if (list == NULL || list == recording_list) return;
+
+    list->deleted = true;
+}
+
+//----------------------------------------------------------------------------------
+// After the frame was drawn: frees deleted lists and ends a recording left open,
+// e.g. by a Lua error between ui.begin_list and ui.end_list
+//----------------------------------------------------------------------------------
+void end_display_list_frame() {
+    if (recording_list != NULL) {
+        printf("Warning: display list still recording at the end of the frame, ended\n");
+        recording_list = NULL;
+    }
+
+    for (int id = 1; id <= display_lists.count; id++) {
+        DisplayList *list = display_list_slot(id);
+        if (list == NULL || !list->deleted) continue;
+
+        free_drawlist(&list->items);
+        free(list);
+        registry_remove(&display_lists, id);
+    }
+}
+
+// Replaying keeps the recorded sheets in use, as drawing them directly would
+static void mark_display_list_used(DisplayList *list) {
+    for (NodeDrawable *node = list->items.root; node != NULL; node = node->next) {
+        SpriteInMemory *sheet = NULL;
+
+        if (node->type == 's') {
+            sheet = ((TileItem *) node->drawable)->sprite_in_memory;
+        } else if (node->type == 'w') {
+            sheet = ((SpriteItem *) node->drawable)->sprite_in_memory;
+        } else if (node->type == 'd') {
+            DisplayList *called = display_list_slot(((CallListItem *) node->drawable)->list);
+            if (called != NULL) mark_display_list_used(called);
+        }
+
+        if (sheet != NULL) {
+            mark_asset_used(sheet);
+            request_sprite_in_memory(sheet);
+        }
+    }
+}
+
+void add_call_list(int id, int x, int y) {
+    DisplayList *list = display_list_slot(id);
+    if (list != NULL) mark_display_list_used(list);
+
+    CallListItem *call = (CallListItem *) malloc(sizeof(CallListItem));
+    call->list = id;
+    call->x = x;
+    call->y = y;
+
+    add_drawable(call, 'd');
+}
+
+void draw_call_list(CallListItem *call) {
+    // A list deleted in an earlier frame, or called from a list that outlived it
+    DisplayList *list = display_list_slot(call->list);
+    if (list == NULL) return;
+
+    rlPushMatrix();
+    rlTranslatef(call->x, call->y, 0);
+
+    NodeDrawable *node = list->items.root;
+    for (; node != NULL; node = node->next) {
+        draw(node);
+    }
+
+    rlPopMatrix();
+}
+
 /**
 Sprite Functions
 **/
 void add_sprite(SpriteInMemory *sprite_in_memory, int x, int y, bool flipped) {
+    mark_asset_used(sprite_in_memory);
+    request_sprite_in_memory(sprite_in_memory);
+
     SpriteItem *sprite = (SpriteItem *) malloc(sizeof(SpriteItem));
     sprite->sprite_in_memory = sprite_in_memory;
     sprite->x = x;
@@ -265,55 +502,116 @@ void add_sprite(SpriteInMemory *sprite_in_memory, int x, int y, bool flipped) {
 }
 
 void draw_sprite(SpriteItem *sprite) {
-    int dest_width = sprite->sprite_in_memory->tile_width;
-    int dest_height = sprite->sprite_in_memory->tile_height;
-    int src_width = dest_width;
-
-    if (sprite->flipped) {
-        src_width = -src_width;
-    }
+    SpriteInMemory *sheet = sprite->sprite_in_memory;
 
-    DrawTexturePro(
-        sprite->sprite_in_memory->texture,
-        (Rectangle) { 0, 0, src_width, sprite->sprite_in_memory->tile_height },
-        (Rectangle) { sprite->x, sprite->y, dest_width, dest_height },
-        (Vector2) { 0, 0 },
-        0,
-        WHITE
-    );
+    draw_sheet_tile(sheet, 0, sprite->x, sprite->y, sprite->flipped ? TILE_FLIP_X : 0);
 }
 
 /**
 Tile Functions
 **/
-void add_tile(SpriteInMemory *sprite_in_memory, int tile_index, int x, int y, bool flipped) {
+//----------------------------------------------------------------------------------
+// Splits a ui.tile value into its tile index and TILE_* flags. Sheets with more
+// tiles than the index bits address take the whole value as the index, unflagged.
+//----------------------------------------------------------------------------------
+void split_tile_value(SpriteInMemory *sprite_in_memory, int value, int *tile_index, int *flags) {
+    if (sprite_in_memory->sheet_ntiles > TILE_INDEX_MASK + 1) {
+        *tile_index = value;
+        *flags = 0;
+    } else {
+        *tile_index = value & TILE_INDEX_MASK;
+        *flags = value & TILE_FLAGS;
+    }
+}
+
+void add_tile(SpriteInMemory *sprite_in_memory, int tile_index, int x, int y, int flags) {
+    mark_asset_used(sprite_in_memory);
+    request_sprite_in_memory(sprite_in_memory);
+
     TileItem *tile = (TileItem *) malloc(sizeof(TileItem));
     tile->sprite_in_memory = sprite_in_memory;
     tile->tile_index = tile_index;
     tile->x = x;
     tile->y = y;
-    tile->flipped = flipped;
+    tile->flags = flags;
 
     add_drawable(tile, 's');
 }
 
 void draw_tile(TileItem *tile) {
-    int src_x = tile->tile_index * tile->sprite_in_memory->tile_width;
-    int src_y = 0;
-    int src_width = tile->sprite_in_memory->tile_width;
+    SpriteInMemory *sheet = tile->sprite_in_memory;
+    int tile_index = sprite_in_memory_tile_frame(sheet, tile->tile_index);
+    if (tile_index < 0 || tile_index >= sheet->ntiles) return;
 
-    if (tile->flipped) {
-        src_width = -src_width;
+    draw_sheet_tile(sheet, tile_index, tile->x, tile->y, tile->flags);
+}
+
+//----------------------------------------------------------------------------------
+// Draws the trimmed part of a tile where it would sit in the full, transformed
+// tile; fully transparent tiles draw nothing
+//----------------------------------------------------------------------------------
+void draw_sheet_tile(SpriteInMemory *sheet, int tile_index, int x, int y, int flags) {
+    SheetRect *rect = &sheet->tile_rects[tile_index];
+    if (rect->src.width == 0) return;
+
+    int tile_width = sheet->tile_width;
+    int tile_height = sheet->tile_height;
+    int offset_x = rect->offset_x;
+    int offset_y = rect->offset_y;
+    int width = rect->src.width;
+    int height = rect->src.height;
+
+    // Move the trimmed box the same way the pixels move: swap, then flip
+    if (flags & TILE_DIAGONAL) {
+        int swap;
+        swap = offset_x; offset_x = offset_y; offset_y = swap;
+        swap = width; width = height; height = swap;
+        swap = tile_width; tile_width = tile_height; tile_height = swap;
     }
+    if (flags & TILE_FLIP_X) offset_x = tile_width - offset_x - width;
+    if (flags & TILE_FLIP_Y) offset_y = tile_height - offset_y - height;
 
-    DrawTexturePro(
-        tile->sprite_in_memory->texture,
-        (Rectangle) { src_x, src_y, src_width, tile->sprite_in_memory->tile_height },
-        (Rectangle) { tile->x, tile->y, tile->sprite_in_memory->tile_width, tile->sprite_in_memory->tile_height },
-        (Vector2) { 0, 0 },
-        0,
-        WHITE
-    );
+    draw_texture_flags(sprite_in_memory_texture(sheet), rect->src, x + offset_x, y + offset_y, flags);
+}
+
+//----------------------------------------------------------------------------------
+// Draws src at (x, y) with TILE_FLIP_X/TILE_FLIP_Y/TILE_DIAGONAL applied by
+// moving the UVs around the quad, so transformed tiles need no extra sheet space
+//----------------------------------------------------------------------------------
+void draw_texture_flags(Texture2D texture, Rectangle src, int x, int y, int flags) {
+    if (texture.id == 0) return;
+
+    bool diagonal = (flags & TILE_DIAGONAL) != 0;
+    float width = diagonal ? src.height : src.width;
+    float height = diagonal ? src.width : src.height;
+
+    // Quad corners in raylib's order: top-left, bottom-left, bottom-right, top-right
+    static const float corners[4][2] = { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } };
+
+    rlSetTexture(texture.id);
+    rlBegin(RL_QUADS);
+    rlColor4ub(255, 255, 255, 255);
+    rlNormal3f(0.0f, 0.0f, 1.0f);
+
+    for (int i = 0; i < 4; i++) {
+        float u = corners[i][0];
+        float v = corners[i][1];
+
+        // Undo the flips in reverse order to find which source corner lands here
+        if (flags & TILE_FLIP_Y) v = 1 - v;
+        if (flags & TILE_FLIP_X) u = 1 - u;
+        if (diagonal) {
+            float swap = u;
+            u = v;
+            v = swap;
+        }
+
+        rlTexCoord2f((src.x + u * src.width) / texture.width, (src.y + v * src.height) / texture.height);
+        rlVertex2f(x + corners[i][0] * width, y + corners[i][1] * height);
+    }
+
+    rlEnd();
+    rlSetTexture(0);
 }
 
 /**
@@ -332,6 +630,11 @@ void palset(int position, int bgr555) {
     palette[position].g = (g5 << 3) | (g5 >> 2);
     palette[position].b = (b5 << 3) | (b5 >> 2);
     palette[position].a = 255;
+
+    // Index 0 stays transparent in the lookup table
+    if (position != 0) {
+        memcpy(&palette_lut[position], &palette[position], sizeof(uint32_t));
+    }
 }
 
 Color get_palette_color(int index) {
@@ -359,38 +662,246 @@ void draw_clear(ClearItem *clear) {
 /**
 Sprites In Memory Functions
 **/
-Image sprite_in_memory_create_image_from_data(char *data, SpriteInMemory *sprite) {
-    int sprite_width = sprite->tile_width * sprite->ntiles;
-    int sprite_height = sprite->tile_height;
+//----------------------------------------------------------------------------------
+// Expands tiles [first_tile, last_tile) into the sheet's RGBA pixels.
+// Only reads the sheet and the palette, so ranges can run on worker threads.
+//----------------------------------------------------------------------------------
+void sprite_in_memory_decode_tiles(SpriteInMemory *sprite, Color *pixels, int first_tile, int last_tile) {
+    uint32_t *out = (uint32_t *) pixels;
+    int tile_bytes = sprite->tile_width * sprite->tile_height;
+
+    // Each row of a trimmed tile is contiguous in both the index data and the sheet image
+    for(int tile_index = first_tile; tile_index < last_tile; tile_index++) {
+        SheetRect *rect = &sprite->tile_rects[tile_index];
+        const uint8_t *tile = sprite->data + tile_index * tile_bytes;
+
+        for(int y = 0; y < (int) rect->src.height; y++) {
+            const uint8_t *row = tile + (rect->offset_y + y) * sprite->tile_width + rect->offset_x;
+            int out_index = ((int) rect->src.y + y) * sprite->sheet_width + (int) rect->src.x;
+
+            expand_indices(row, out + out_index, (int) rect->src.width, palette_lut);
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------
+// Bounding box of the non-zero indices of a tile; width 0 when all transparent
+//----------------------------------------------------------------------------------
+static SheetRect sprite_in_memory_trim_tile(SpriteInMemory *sprite, int tile_index) {
+    const uint8_t *tile = sprite->data + tile_index * sprite->tile_width * sprite->tile_height;
+    int min_x = sprite->tile_width, min_y = sprite->tile_height, max_x = -1, max_y = -1;
+
+    for (int y = 0; y < sprite->tile_height; y++) {
+        for (int x = 0; x < sprite->tile_width; x++) {
+            if (tile[y * sprite->tile_width + x] == 0) continue;
+
+            if (x < min_x) min_x = x;
+            if (x > max_x) max_x = x;
+            if (y < min_y) min_y = y;
+            if (y > max_y) max_y = y;
+        }
+    }
+
+    if (max_x < 0) return (SheetRect) { { 0, 0, 0, 0 }, 0, 0 };
 
-    Image image = GenImageColor(sprite_width, sprite_height, BLANK);
+    return (SheetRect) { { 0, 0, max_x - min_x + 1, max_y - min_y + 1 }, min_x, min_y };
+}
+
+//----------------------------------------------------------------------------------
+// Trims every tile to its opaque box and packs the boxes on shelves, tallest
+// first. Shelves are columns tiles wide; columns <= 0 picks a roughly square
+// sheet. Either way the texture is kept within MAX_SHEET_TEXTURE_SIZE wide.
+// A sheet that comes out too tall is packed again as wide as allowed; returns
+// false if it still does not fit in a MAX_SHEET_TEXTURE_SIZE texture.
+//----------------------------------------------------------------------------------
+bool sprite_in_memory_layout(SpriteInMemory *sprite, int columns) {
+    if (columns <= 0) {
+        columns = (int) ceil(sqrt((double) sprite->ntiles));
+    }
+
+    int max_columns = MAX_SHEET_TEXTURE_SIZE / sprite->tile_width;
+    if (columns > max_columns) columns = max_columns;
+    if (columns > sprite->ntiles) columns = sprite->ntiles;
+    if (columns < 1) columns = 1;
+
+    sprite->tile_rects = (SheetRect *) realloc(sprite->tile_rects, sizeof(SheetRect) * sprite->ntiles);
+
+    int *order = (int *) malloc(sizeof(int) * sprite->ntiles);
+
+    for (int i = 0; i < sprite->ntiles; i++) {
+        sprite->tile_rects[i] = sprite_in_memory_trim_tile(sprite, i);
+
+        // Insertion sort by height, tallest first
+        int k = i;
+        while (k > 0 && sprite->tile_rects[order[k - 1]].src.height < sprite->tile_rects[i].src.height) {
+            order[k] = order[k - 1];
+            k--;
+        }
+        order[k] = i;
+    }
+
+    int used_width, used_height;
 
-    Color *pixels = (Color *)image.data;
+    for (;;) {
+        int shelf_width = columns * sprite->tile_width;
+        int shelf_x = 0, shelf_y = 0, shelf_height = 0;
+        used_width = 0;
 
-    int data_index = 0;
-    for(int tile_index = 0; tile_index < sprite->ntiles; tile_index++) {
-        for(int y = 0; y < sprite->tile_height; y++) {
-            for(int x = 0; x < sprite->tile_width; x++) {
-                int pixel_index = (x + (tile_index * sprite->tile_width)) + (sprite_width * y);
+        for (int i = 0; i < sprite->ntiles; i++) {
+            SheetRect *rect = &sprite->tile_rects[order[i]];
+            if (rect->src.width == 0) continue;
 
-                pixels[pixel_index] = get_palette_color((int) data[data_index++]);
+            if (shelf_x + rect->src.width > shelf_width) {
+                shelf_y += shelf_height;
+                shelf_x = 0;
+                shelf_height = 0;
             }
+
+            rect->src.x = shelf_x;
+            rect->src.y = shelf_y;
+
+            shelf_x += rect->src.width;
+            if (shelf_x > used_width) used_width = shelf_x;
+            if (rect->src.height > shelf_height) shelf_height = rect->src.height;
         }
+
+        used_height = shelf_y + shelf_height;
+        if (used_height <= MAX_SHEET_TEXTURE_SIZE) break;
+
+        // Too tall: widen the shelves to the limit, or give up if they already are
+        int widest = max_columns < sprite->ntiles ? max_columns : sprite->ntiles;
+        if (columns >= widest) break;
+        columns = widest;
+    }
+
+    // Keep a 1x1 texture for sheets with nothing opaque
+    sprite->columns = columns;
+    sprite->sheet_width = used_width > 0 ? used_width : 1;
+    sprite->sheet_height = used_height > 0 ? used_height : 1;
+
+    free(order);
+
+    return used_height <= MAX_SHEET_TEXTURE_SIZE;
+}
+
+static int sprite_in_memory_texture_bytes(SpriteInMemory *sprite) {
+    return sprite->sheet_width * sprite->sheet_height * 4;
+}
+
+void sprite_in_memory_upload(SpriteInMemory *sprite) {
+    upload_sprites_in_memory(&sprite, 1);
+}
+
+static void sprite_in_memory_upload_image(SpriteInMemory *sprite, Image image) {
+    sprite_in_memory_unload(sprite);
+
+    sprite->texture = LoadTextureFromImage(image);
+
+    texture_stats.resident_bytes += sprite_in_memory_texture_bytes(sprite);
+    sprite->last_used = current_frame;
+
+    if (sprite->evicted) {
+        texture_stats.reloads++;
+        sprite->evicted = false;
+    }
+}
+
+//----------------------------------------------------------------------------------
+// Decodes the sheets together (in parallel with LUPI_THREADS), then uploads
+// them one by one from this thread
+//----------------------------------------------------------------------------------
+void upload_sprites_in_memory(SpriteInMemory **sheets, int count) {
+    if (count <= 0) return;
+
+    Image *images = (Image *) malloc(sizeof(Image) * count);
+    Color **pixels = (Color **) malloc(sizeof(Color *) * count);
+
+    for (int i = 0; i < count; i++) {
+        images[i] = GenImageColor(sheets[i]->sheet_width, sheets[i]->sheet_height, BLANK);
+        pixels[i] = (Color *) images[i].data;
+    }
+
+    decode_sheets(sheets, pixels, count);
+
+    for (int i = 0; i < count; i++) {
+        sprite_in_memory_upload_image(sheets[i], images[i]);
+        UnloadImage(images[i]);
+    }
+
+    free(images);
+    free(pixels);
+}
+
+//----------------------------------------------------------------------------------
+// Frees the texture only; index data stays so the sheet can be uploaded again
+//----------------------------------------------------------------------------------
+void sprite_in_memory_unload(SpriteInMemory *sprite) {
+    if (sprite->texture.id == 0) return;
+
+    // Sized from the texture itself: the layout may have grown since the upload
+    texture_stats.resident_bytes -= sprite->texture.width * sprite->texture.height * 4;
+    UnloadTexture(sprite->texture);
+    sprite->texture.id = 0;
+}
+
+//----------------------------------------------------------------------------------
+// Sheets are registered without a texture; it is created the first time the
+// sheet is drawn, or earlier when preloaded
+//----------------------------------------------------------------------------------
+Texture2D sprite_in_memory_texture(SpriteInMemory *sprite) {
+    if (sprite->texture.id == 0 && sprite->data != NULL) {
+        sprite_in_memory_upload(sprite);
     }
 
-    return image;
+    sprite->last_used = current_frame;
+
+    return sprite->texture;
 }
 
-void add_sprite_in_memory(char *name, char *data, int width, int height, int ntiles) {
+void sprite_in_memory_restore(SpriteInMemory *sprite, const char *data) {
+    int size = sprite->tile_width * sprite->tile_height * sprite->ntiles;
+
+    sprite->data = (unsigned char *) malloc(size);
+    memcpy(sprite->data, data, size);
+}
+
+void sprite_in_memory_release(SpriteInMemory *sprite) {
+    sprite_in_memory_unload(sprite);
+    sprite->evicted = false;
+
+    free(sprite->data);
+    sprite->data = NULL;
+}
+
+void add_sprite_in_memory(char *name, char *data, int width, int height, int ntiles, int columns) {
     SpriteInMemory *sprite = (SpriteInMemory *) malloc(sizeof(SpriteInMemory));
     strcpy(sprite->name, name);
     sprite->tile_width = width;
     sprite->tile_height = height;
     sprite->ntiles = ntiles;
-
-    Image image = sprite_in_memory_create_image_from_data(data, sprite);
-    sprite->texture = LoadTextureFromImage(image);
-    UnloadImage(image);
+    sprite->sheet_ntiles = ntiles;
+    sprite->tile_anims = NULL;
+    sprite->anim_version = 0;
+    sprite->texture.id = 0;
+    sprite->group = 0;
+    sprite->derived = false;
+    sprite->last_used = 0;
+    sprite->evicted = false;
+    sprite->tile_rects = NULL;
+
+    // Index data stays in memory so tilesets can be compared tile by tile
+    // and textures can be uploaded lazily; the layout trims tiles from it
+    sprite->data = (unsigned char *) malloc(width * height * ntiles);
+    memcpy(sprite->data, data, width * height * ntiles);
+
+    if (!sprite_in_memory_layout(sprite, columns)) {
+        printf("Sprite %s: %d tiles of %dx%d do not fit in a %dx%d texture, not added\n",
+            name, ntiles, width, height, MAX_SHEET_TEXTURE_SIZE, MAX_SHEET_TEXTURE_SIZE);
+        free(sprite->tile_rects);
+        free(sprite->data);
+        free(sprite);
+        return;
+    }
 
     sprites_in_memory.count++;
 
@@ -404,6 +915,132 @@ void add_sprite_in_memory(char *name, char *data, int width, int height, int nti
     printf("Sprite %s added to sprites in memory\n", name);
 }
 
+/**
+Texture Budget Functions
+**/
+TextureStats texture_stats;
+
+//----------------------------------------------------------------------------------
+// Evicts the least recently drawn sheets until resident textures fit the budget.
+// Runs after the frame is drawn; sheets drawn this frame are never evicted.
+//----------------------------------------------------------------------------------
+void enforce_texture_budget() {
+    if (texture_stats.budget_bytes <= 0) return;
+
+    while (texture_stats.resident_bytes > texture_stats.budget_bytes) {
+        SpriteInMemory *oldest = NULL;
+
+        for (int i = 0; i < sprites_in_memory.count; i++) {
+            SpriteInMemory *sprite = sprites_in_memory.sprites[i];
+            if (sprite->texture.id == 0 || sprite->data == NULL) continue;
+            if (sprite->last_used >= current_frame) continue;
+
+            if (oldest == NULL || sprite->last_used < oldest->last_used) {
+                oldest = sprite;
+            }
+        }
+
+        if (oldest == NULL) break;
+
+        sprite_in_memory_unload(oldest);
+        oldest->evicted = true;
+        texture_stats.evictions++;
+    }
+}
+
+void update_texture_stats(double now) {
+    if (now - texture_stats.window_start < 1.0) return;
+
+    texture_stats.evictions_per_sec = texture_stats.evictions;
+    texture_stats.reloads_per_sec = texture_stats.reloads;
+    texture_stats.evictions = 0;
+    texture_stats.reloads = 0;
+    texture_stats.window_start = now;
+}
+
+/**
+Preload Functions
+**/
+static SpriteInMemory **preload_queue = NULL;
+static int preload_count = 0;
+static int preload_max_count = 0;
+
+void preload_sprite_in_memory(SpriteInMemory *sprite) {
+    if (sprite == NULL || sprite->texture.id != 0) return;
+
+    for (int i = 0; i < preload_count; i++) {
+        if (preload_queue[i] == sprite) return;
+    }
+
+    if (preload_count >= preload_max_count) {
+        preload_max_count = preload_max_count == 0 ? 16 : preload_max_count * 2;
+        preload_queue = (SpriteInMemory **) realloc(preload_queue, sizeof(SpriteInMemory *) * preload_max_count);
+    }
+
+    preload_queue[preload_count++] = sprite;
+}
+
+//----------------------------------------------------------------------------------
+// Uploads queued sheets until budget_bytes of texture data went up this frame.
+// At least one sheet is uploaded, so a sheet larger than the budget still loads.
+//----------------------------------------------------------------------------------
+void process_preload_queue(int budget_bytes) {
+    SpriteInMemory *batch[16];
+    int batch_count = 0;
+    int uploaded_bytes = 0;
+    int done = 0;
+
+    while (done < preload_count && batch_count < 16 && (batch_count == 0 || uploaded_bytes < budget_bytes)) {
+        SpriteInMemory *sprite = preload_queue[done++];
+        if (sprite->texture.id != 0 || sprite->data == NULL) continue;
+
+        batch[batch_count++] = sprite;
+        uploaded_bytes += sprite_in_memory_texture_bytes(sprite);
+    }
+
+    upload_sprites_in_memory(batch, batch_count);
+
+    memmove(preload_queue, preload_queue + done, sizeof(SpriteInMemory *) * (preload_count - done));
+    preload_count -= done;
+}
+
+//----------------------------------------------------------------------------------
+// Sheets drawn this frame without a texture are collected while Lua runs and
+// decoded together before drawing, instead of one at a time inside draw()
+//----------------------------------------------------------------------------------
+static SpriteInMemory **requested = NULL;
+static int requested_count = 0;
+static int requested_max_count = 0;
+
+void request_sprite_in_memory(SpriteInMemory *sprite) {
+    if (sprite == NULL || sprite->texture.id != 0 || sprite->data == NULL) return;
+
+    for (int i = 0; i < requested_count; i++) {
+        if (requested[i] == sprite) return;
+    }
+
+    if (requested_count >= requested_max_count) {
+        requested_max_count = requested_max_count == 0 ? 16 : requested_max_count * 2;
+        requested = (SpriteInMemory **) realloc(requested, sizeof(SpriteInMemory *) * requested_max_count);
+    }
+
+    requested[requested_count++] = sprite;
+}
+
+void upload_requested_sprites() {
+    int count = 0;
+
+    // A sheet may have been uploaded or released since it was requested
+    for (int i = 0; i < requested_count; i++) {
+        if (requested[i]->texture.id == 0 && requested[i]->data != NULL) {
+            requested[count++] = requested[i];
+        }
+    }
+
+    upload_sprites_in_memory(requested, count);
+    requested_count = 0;
+}
+
 SpriteInMemory* get_sprite_in_memory(char *name) {
     for(int i = 0; i < sprites_in_memory.count; i++) {
         if(strcmp(sprites_in_memory.sprites[i]->name, name) == 0) {
@@ -412,3 +1049,134 @@ SpriteInMemory* get_sprite_in_memory(char *name) {
     }
     return NULL;
 }
+
+/**
+Tile Animation Functions
+**/
+void set_tile_anim(SpriteInMemory *sprite, int tile_index, uint16_t *frames, int frame_count, int cadency) {
+    if (tile_index < 0 || tile_index >= sprite->ntiles) return;
+
+    if (sprite->tile_anims == NULL) {
+        sprite->tile_anims = (TileAnim *) calloc(sprite->ntiles, sizeof(TileAnim));
+    }
+
+    TileAnim *anim = &sprite->tile_anims[tile_index];
+    free(anim->frames);
+    anim->frames = NULL;
+    anim->frame_count = 0;
+
+    if (frame_count > 1) {
+        anim->frames = (uint16_t *) malloc(sizeof(uint16_t) * frame_count);
+        memcpy(anim->frames, frames, sizeof(uint16_t) * frame_count);
+        anim->frame_count = frame_count;
+        anim->cadency = cadency > 0 ? cadency : 1;
+    }
+
+    sprite->anim_version++;
+}
+
+bool sprite_in_memory_tile_is_animated(SpriteInMemory *sprite, int tile_index) {
+    if (sprite->tile_anims == NULL || tile_index < 0 || tile_index >= sprite->ntiles) return false;
+    return sprite->tile_anims[tile_index].frame_count > 1;
+}
+
+int sprite_in_memory_tile_frame(SpriteInMemory *sprite, int tile_index) {
+    if (!sprite_in_memory_tile_is_animated(sprite, tile_index)) return tile_index;
+
+    TileAnim *anim = &sprite->tile_anims[tile_index];
+    return anim->frames[(current_frame / anim->cadency) % anim->frame_count];
+}
+
+//----------------------------------------------------------------------------------
+// Turns a family of whole-sheet animation frames into per-tile animations of the
+// base sheet. Only the tiles that differ from frame to frame are appended to it;
+// the frame sheets are released afterwards, so the tileset is stored once.
+//----------------------------------------------------------------------------------
+void merge_tile_anim_sheets(SpriteInMemory *base, SpriteInMemory **sheets, int sheet_count, int cadency) {
+    int tile_bytes = base->tile_width * base->tile_height;
+    int base_ntiles = base->ntiles;
+    int base_columns = base->columns;
+    int frame_count = sheet_count + 1;
+
+    uint16_t *frames = (uint16_t *) malloc(sizeof(uint16_t) * frame_count * base_ntiles);
+    int extra_tiles = 0;
+    unsigned char *data = NULL;
+
+    for (int i = 0; i < base_ntiles; i++) {
+        uint16_t *tile_frames = &frames[i * frame_count];
+        tile_frames[0] = i;
+
+        for (int k = 0; k < sheet_count; k++) {
+            unsigned char *pixels = sheets[k]->data + i * tile_bytes;
+            tile_frames[k + 1] = i;
+
+            // Reuse the base tile or an earlier frame when the pixels match
+            bool found = false;
+            for (int f = 0; f <= k && !found; f++) {
+                unsigned char *seen = tile_frames[f] < base_ntiles
+                    ? base->data + tile_frames[f] * tile_bytes
+                    : data + (tile_frames[f] - base_ntiles) * tile_bytes;
+
+                if (memcmp(seen, pixels, tile_bytes) == 0) {
+                    tile_frames[k + 1] = tile_frames[f];
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                data = (unsigned char *) realloc(data, (extra_tiles + 1) * tile_bytes);
+                memcpy(data + extra_tiles * tile_bytes, pixels, tile_bytes);
+                tile_frames[k + 1] = base_ntiles + extra_tiles;
+                extra_tiles++;
+            }
+        }
+    }
+
+    if (extra_tiles > 0) {
+        base->data = (unsigned char *) realloc(base->data, (base_ntiles + extra_tiles) * tile_bytes);
+        memcpy(base->data + base_ntiles * tile_bytes, data, extra_tiles * tile_bytes);
+        base->ntiles = base_ntiles + extra_tiles;
+
+        if (!sprite_in_memory_layout(base, base->columns)) {
+            // Leave the base sheet and the frame sheets as they were
+            printf("Sprite %s: %d frame tiles do not fit in a %dx%d texture, animation not merged\n",
+                base->name, extra_tiles, MAX_SHEET_TEXTURE_SIZE, MAX_SHEET_TEXTURE_SIZE);
+            base->ntiles = base_ntiles;
+            sprite_in_memory_layout(base, base_columns);
+            free(data);
+            free(frames);
+            return;
+        }
+
+        // The merged data can no longer be recovered from the SpriteSheets entry
+        base->derived = true;
+
+        if (base->tile_anims != NULL) {
+            base->tile_anims = (TileAnim *) realloc(base->tile_anims, sizeof(TileAnim) * base->ntiles);
+            memset(base->tile_anims + base_ntiles, 0, sizeof(TileAnim) * extra_tiles);
+        }
+
+        // The texture no longer matches the data; it is uploaded again on next use
+        sprite_in_memory_unload(base);
+    }
+
+    for (int i = 0; i < base_ntiles; i++) {
+        bool animated = false;
+        for (int f = 1; f < frame_count; f++) {
+            if (frames[i * frame_count + f] != i) animated = true;
+        }
+
+        if (animated) {
+            set_tile_anim(base, i, &frames[i * frame_count], frame_count, cadency);
+        }
+    }
+
+    for (int k = 0; k < sheet_count; k++) {
+        if (sheets[k] != base) sprite_in_memory_release(sheets[k]);
+    }
+
+    printf("Sprite %s: %d animated frame tiles merged from %d sheets\n", base->name, extra_tiles, sheet_count);
+
+    free(data);
+    free(frames);
+}
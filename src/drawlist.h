@@ -9,6 +9,7 @@
 Drawlist Functions
 */
 void draw(NodeDrawable *node);
+void free_drawlist(Drawlist *list);
 void clear_drawlist();
 void add_drawable(void *drawable, char type);
 
@@ -30,8 +31,31 @@ void draw_clear(ClearItem *clear);
 void add_triangle(int p1_x, int p1_y, int p2_x, int p2_y, int p3_x, int p3_y, Color color);
 void draw_triangle(TriangleItem *triangle);
 
-void add_tile(SpriteInMemory *sprite_in_memory, int tile_index, int x, int y, bool flipped);
+BatchItem* batch_for_color(Color color, int extra_vertices);
+void batch_push_vertex(BatchItem *batch, float x, float y);
+void batch_add_quad(int x, int y, int width, int height, Color color);
+void batch_add_circle(int center_x, int center_y, float radius, Color color);
+void draw_batch(BatchItem *batch);
+
+/*
+Display List Functions
+*/
+extern Registry display_lists;
+int begin_display_list();
+void end_display_list();
+DisplayList* get_display_list(int id);
+bool is_recording_display_list(DisplayList *list);
+DisplayList* get_recording_display_list();
+void delete_display_list(int id);
+void end_display_list_frame();
+void add_call_list(int id, int x, int y);
+void draw_call_list(CallListItem *call);
+
+void split_tile_value(SpriteInMemory *sprite_in_memory, int value, int *tile_index, int *flags);
+void add_tile(SpriteInMemory *sprite_in_memory, int tile_index, int x, int y, int flags);
 void draw_tile(TileItem *tile);
+void draw_sheet_tile(SpriteInMemory *sheet, int tile_index, int x, int y, int flags);
+void draw_texture_flags(Texture2D texture, Rectangle src, int x, int y, int flags);
 void add_sprite(SpriteInMemory *sprite_in_memory, int x, int y, bool flipped);
 void draw_sprite(SpriteItem *sprite);
 
@@ -40,6 +64,7 @@ Palette Functions
 */
 #define PALETTE_SIZE 256
 extern Color palette[PALETTE_SIZE];
+extern uint32_t palette_lut[PALETTE_SIZE];
 void palset(int position, int bgr555);
 Color get_palette_color(int index);
 
@@ -53,8 +78,36 @@ Sprites In Memory Functions
 */
 extern SpritesInMemory sprites_in_memory;
 void load_sprites_in_memory_from_lua(lua_State *L);
-void add_sprite_in_memory(char *name, char *data, int width, int height, int ntiles);
+void add_sprite_in_memory(char *name, char *data, int width, int height, int ntiles, int columns);
+bool sprite_in_memory_layout(SpriteInMemory *sprite, int columns);
 SpriteInMemory* get_sprite_in_memory(char *name);
+void sprite_in_memory_decode_tiles(SpriteInMemory *sprite, Color *pixels, int first_tile, int last_tile);
+void sprite_in_memory_upload(SpriteInMemory *sprite);
+void upload_sprites_in_memory(SpriteInMemory **sheets, int count);
+void sprite_in_memory_unload(SpriteInMemory *sprite);
+Texture2D sprite_in_memory_texture(SpriteInMemory *sprite);
+void sprite_in_memory_restore(SpriteInMemory *sprite, const char *data);
+void sprite_in_memory_release(SpriteInMemory *sprite);
+void preload_sprite_in_memory(SpriteInMemory *sprite);
+void process_preload_queue(int budget_bytes);
+void request_sprite_in_memory(SpriteInMemory *sprite);
+void upload_requested_sprites();
+
+/*
+Texture Budget Functions
+*/
+extern TextureStats texture_stats;
+void enforce_texture_budget();
+void update_texture_stats(double now);
+
+/*
+Tile Animation Functions
+*/
+extern int current_frame;
+void set_tile_anim(SpriteInMemory *sprite, int tile_index, uint16_t *frames, int frame_count, int cadency);
+bool sprite_in_memory_tile_is_animated(SpriteInMemory *sprite, int tile_index);
+int sprite_in_memory_tile_frame(SpriteInMemory *sprite, int tile_index);
+void merge_tile_anim_sheets(SpriteInMemory *base, SpriteInMemory **sheets, int sheet_count, int cadency);
 
 /*
 Lua Functions
@@ -73,14 +126,56 @@ int lua_spr(lua_State *L);
 int lua_require_sprites(lua_State *L);
 int lua_btn(lua_State *L);
 int lua_btnp(lua_State *L);
+int lua_get_controller_state(lua_State *L);
 int lua_fillp(lua_State *L);
 int lua_log(lua_State *L);
 int lua_cls(lua_State *L);
+int lua_begin_list(lua_State *L);
+int lua_end_list(lua_State *L);
+int lua_call_list(lua_State *L);
+int lua_delete_list(lua_State *L);
+int lua_tilemap(lua_State *L);
+int lua_tilemap_draw(lua_State *L);
+int lua_tilemap_set(lua_State *L);
+int lua_tilemap_free(lua_State *L);
+int lua_map_open(lua_State *L);
+int lua_map_size(lua_State *L);
+int lua_map_get(lua_State *L);
+int lua_map_stream(lua_State *L);
+int lua_map_cells(lua_State *L);
+int lua_map_close(lua_State *L);
+int lua_bg_layer(lua_State *L);
+int lua_bg_draw(lua_State *L);
+int lua_tile_anim(lua_State *L);
+int lua_tile_anim_sheets(lua_State *L);
+int lua_preload_spritesheet(lua_State *L);
+int lua_begin_assets(lua_State *L);
+int lua_release_assets(lua_State *L);
+int lua_texture_budget(lua_State *L);
+int lua_stats(lua_State *L);
+int lua_gc_collect(lua_State *L);
+int lua_alloc_profile(lua_State *L);
+int lua_alloc_report(lua_State *L);
+void open_box_type(lua_State *L);
+void reset_box_scratch();
+int lua_box(lua_State *L);
+int lua_box_scratch(lua_State *L);
+int lua_spatial(lua_State *L);
+int lua_spatial_set(lua_State *L);
+int lua_spatial_remove(lua_State *L);
+int lua_spatial_query(lua_State *L);
+int lua_spatial_free(lua_State *L);
+int lua_emitter(lua_State *L);
+int lua_emitter_at(lua_State *L);
+int lua_emitter_draw(lua_State *L);
+int lua_emitter_free(lua_State *L);
+int lua_body(lua_State *L);
+int lua_body_step(lua_State *L);
+int lua_body_free(lua_State *L);
 
 // TODO
 int lua_camera(lua_State *L);
 int lua_clip(lua_State *L);
-int lua_preload_spritesheet(lua_State *L);
 int lua_draw_sprite(lua_State *L);
 int lua_print(lua_State *L);
 int lua_set_pallet(lua_State *L);
@@ -0,0 +1,47 @@
+#include "expand.h"
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
+/**
+Palette Expansion Functions
+**/
+void expand_indices_scalar(const uint8_t *indices, uint32_t *out, int count, const uint32_t *lut) {
+    for (int i = 0; i < count; i++) {
+        out[i] = lut[indices[i]];
+    }
+}
+
+#if defined(__AVX2__)
+//----------------------------------------------------------------------------------
+// Eight indices widened to 32 bits and gathered from the table in one go
+//----------------------------------------------------------------------------------
+void expand_indices(const uint8_t *indices, uint32_t *out, int count, const uint32_t *lut) {
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i bytes = _mm_loadl_epi64((const __m128i *) (indices + i));
+        __m256i index = _mm256_cvtepu8_epi32(bytes);
+        __m256i colors = _mm256_i32gather_epi32((const int *) lut, index, 4);
+        _mm256_storeu_si256((__m256i *) (out + i), colors);
+    }
+
+    expand_indices_scalar(indices + i, out + i, count - i, lut);
+}
+
+const char* expand_kernel_name() { return "avx2"; }
+
+#else
+//----------------------------------------------------------------------------------
+// Without a gather the plain loop is as fast as anything tried so far: a pshufb
+// lookup over 16-entry slices of the table only breaks even on the game's
+// sheets (see tests/bench_expand.c)
+//----------------------------------------------------------------------------------
+void expand_indices(const uint8_t *indices, uint32_t *out, int count, const uint32_t *lut) {
+    expand_indices_scalar(indices, out, count, lut);
+}
+
+const char* expand_kernel_name() { return "scalar"; }
+
+#endif
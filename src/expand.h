@@ -0,0 +1,13 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include <stdint.h>
+
+/*
+Palette Expansion Functions
+*/
+void expand_indices(const uint8_t *indices, uint32_t *out, int count, const uint32_t *lut);
+void expand_indices_scalar(const uint8_t *indices, uint32_t *out, int count, const uint32_t *lut);
+const char* expand_kernel_name();
+
+#endif
@@ -0,0 +1,167 @@
+#include <string.h>
+
+#include "drawlist.h"
+#include "input.h"
+
+#if defined(PLATFORM_WEB)
+    #include <emscripten/emscripten.h>
+    #include <emscripten/html5.h>
+#endif
+
+/*
+Global vars
+*/
+InputSnapshot input_snapshot;
+InputQueue input_queue;
+
+//----------------------------------------------------------------------------------
+// Keyboard key standing in for a gamepad button, on every pad
+//----------------------------------------------------------------------------------
+static int get_keyboard_key_for_button(int button) {
+    switch (button) {
+        // D-pad / Arrow keys
+        case GAMEPAD_BUTTON_LEFT_FACE_UP:    return KEY_UP;
+        case GAMEPAD_BUTTON_LEFT_FACE_DOWN:  return KEY_DOWN;
+        case GAMEPAD_BUTTON_LEFT_FACE_LEFT:  return KEY_LEFT;
+        case GAMEPAD_BUTTON_LEFT_FACE_RIGHT: return KEY_RIGHT;
+        // Action buttons
+        case GAMEPAD_BUTTON_RIGHT_FACE_RIGHT: return KEY_Z;  // BTN_Z
+        case GAMEPAD_BUTTON_RIGHT_FACE_DOWN:  return KEY_Z;  // BTN_Z (alternative)
+        case GAMEPAD_BUTTON_RIGHT_FACE_UP:    return KEY_X;  // BTN_Q
+        case GAMEPAD_BUTTON_RIGHT_FACE_LEFT:  return KEY_A;  // BTN_E
+        // Start
+        case GAMEPAD_BUTTON_MIDDLE_RIGHT:     return KEY_ENTER;
+        default: return -1;
+    }
+}
+
+// Buttons a keyboard key stands in for; KEY_Z covers two
+static uint32_t buttons_for_key(int key) {
+    uint32_t buttons = 0;
+    for (int button = 1; button < PAD_BUTTONS; button++) {
+        if (get_keyboard_key_for_button(button) == key) buttons |= 1u << button;
+    }
+    return buttons;
+}
+
+// Seconds, on the same clock the key events are stamped with
+double input_time(void) {
+#if defined(PLATFORM_WEB)
+    return emscripten_get_now() / 1000.0;
+#else
+    return GetTime();
+#endif
+}
+
+void queue_key_press(int key, double time) {
+    if (input_queue.count == INPUT_QUEUE_SIZE) {
+        input_queue.dropped++;
+        return;
+    }
+
+    InputEvent *event = &input_queue.events[(input_queue.head + input_queue.count) % INPUT_QUEUE_SIZE];
+    event->key = key;
+    event->time = time;
+    input_queue.count++;
+}
+
+#if defined(PLATFORM_WEB)
+// DOM key codes for the keys get_keyboard_key_for_button() uses
+static int key_for_code(const char *code) {
+    static const struct { const char *code; int key; } codes[] = {
+        { "ArrowUp", KEY_UP }, { "ArrowDown", KEY_DOWN }, { "ArrowLeft", KEY_LEFT }, { "ArrowRight", KEY_RIGHT },
+        { "KeyZ", KEY_Z }, { "KeyX", KEY_X }, { "KeyA", KEY_A }, { "Enter", KEY_ENTER }
+    };
+
+    for (int i = 0; i < (int) (sizeof(codes) / sizeof(codes[0])); i++) {
+        if (strcmp(codes[i].code, code) == 0) return codes[i].key;
+    }
+    return -1;
+}
+
+// Runs as the browser delivers the event, between frames; returning false
+// leaves the event to raylib's own handlers
+static EM_BOOL on_key_down(int event_type, const EmscriptenKeyboardEvent *event, void *user_data) {
+    if (event->repeat) return EM_FALSE;
+
+    int key = key_for_code(event->code);
+    if (key != -1) queue_key_press(key, input_time());
+
+    return EM_FALSE;
+}
+#endif
+
+//----------------------------------------------------------------------------------
+// On the web key presses are queued from the browser's keydown events with the
+// time they arrive; natively raylib's GetKeyPressed() queue is drained instead
+//----------------------------------------------------------------------------------
+void init_input(void) {
+    memset(&input_queue, 0, sizeof(input_queue));
+
+#if defined(PLATFORM_WEB)
+    emscripten_set_keydown_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, NULL, EM_FALSE, on_key_down);
+#endif
+}
+
+//----------------------------------------------------------------------------------
+// Polls the keyboard and the connected gamepads once and derives the press
+// and release edges from the previous frame's snapshot. Queued key presses
+// count as pressed and down for this frame even if the key is already up
+// again. ui.btn, ui.btnp and sys.get_controller_state all read from here.
+//----------------------------------------------------------------------------------
+void sample_input(int frame) {
+    double now = input_time();
+
+#if !defined(PLATFORM_WEB)
+    for (int key = GetKeyPressed(); key != 0; key = GetKeyPressed()) {
+        queue_key_press(key, now);
+    }
+#endif
+
+    uint32_t taps = 0;
+    for (; input_queue.count > 0; input_queue.count--) {
+        InputEvent *event = &input_queue.events[input_queue.head];
+        input_queue.head = (input_queue.head + 1) % INPUT_QUEUE_SIZE;
+
+        uint32_t buttons = buttons_for_key(event->key);
+        if (buttons == 0) continue;
+
+        taps |= buttons;
+        input_queue.total++;
+        input_queue.latency_ms = (now - event->time) * 1000.0;
+        if (input_queue.latency_ms > input_queue.max_latency_ms) input_queue.max_latency_ms = input_queue.latency_ms;
+    }
+
+    uint32_t keyboard = taps;
+    for (int button = 1; button < PAD_BUTTONS; button++) {
+        int key = get_keyboard_key_for_button(button);
+        if (key != -1 && IsKeyDown(key)) keyboard |= 1u << button;
+    }
+
+    for (int pad = 0; pad < MAX_PADS; pad++) {
+        PadState *state = &input_snapshot.pads[pad];
+        uint32_t down = keyboard;
+
+        if (IsGamepadAvailable(pad)) {
+            for (int button = 1; button < PAD_BUTTONS; button++) {
+                if (IsGamepadButtonDown(pad, button)) down |= 1u << button;
+            }
+        }
+
+        state->pressed = (down & ~state->down) | taps;
+        state->released = state->down & ~down;
+        state->down = down;
+    }
+
+    input_snapshot.frame = frame;
+}
+
+bool pad_button_down(int pad, int button) {
+    if (pad < 0 || pad >= MAX_PADS || button < 0 || button >= PAD_BUTTONS) return false;
+    return (input_snapshot.pads[pad].down >> button) & 1u;
+}
+
+bool pad_button_pressed(int pad, int button) {
+    if (pad < 0 || pad >= MAX_PADS || button < 0 || button >= PAD_BUTTONS) return false;
+    return (input_snapshot.pads[pad].pressed >> button) & 1u;
+}
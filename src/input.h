@@ -0,0 +1,18 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "types.h"
+
+/*
+Input Snapshot Functions
+*/
+extern InputSnapshot input_snapshot;
+extern InputQueue input_queue;
+void init_input(void);
+void queue_key_press(int key, double time);
+double input_time(void);
+void sample_input(int frame);
+bool pad_button_down(int pad, int button);
+bool pad_button_pressed(int pad, int button);
+
+#endif
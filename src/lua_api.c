@@ -1,12 +1,65 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <lua.h>
 #include <lualib.h>
 #include <lauxlib.h>
 
 #include "drawlist.h"
+#include "tilemap.h"
+#include "mapfile.h"
+#include "assets.h"
+#include "luaalloc.h"
+#include "luagc.h"
+#include "bytecode.h"
+#include "luaprof.h"
+#include "spatial.h"
+#include "particles.h"
+#include "body.h"
+#include "input.h"
 #include "raylib.h"
 
+//----------------------------------------------------------------------------------
+// Helper function to get the sheet for a SpriteSheets entry at the given index.
+// Sheets released with their asset group get their index data back from the entry.
+//----------------------------------------------------------------------------------
+static SpriteInMemory* check_sprite_in_memory(lua_State *L, int index) {
+    index = lua_absindex(L, index);
+    luaL_checktype(L, index, LUA_TTABLE);
+
+    lua_getfield(L, index, "name");
+    const char *name = luaL_checkstring(L, -1);
+    SpriteInMemory *sprite_in_memory = get_sprite_in_memory((char *) name);
+    lua_pop(L, 1);
+
+    if (sprite_in_memory == NULL) return NULL;
+
+    if (sprite_in_memory->data == NULL) {
+        size_t length = 0;
+        lua_getfield(L, index, "data");
+        const char *data = lua_tolstring(L, -1, &length);
+
+        if (data != NULL && length >= (size_t) (sprite_in_memory->tile_width * sprite_in_memory->tile_height * sprite_in_memory->ntiles)) {
+            sprite_in_memory_restore(sprite_in_memory, data);
+        }
+        lua_pop(L, 1);
+    }
+
+    return sprite_in_memory;
+}
+
+static MapFile* check_map_file(lua_State *L, int index) {
+    int id = luaL_checkinteger(L, index);
+    MapFile *map = get_map_file(id);
+
+    if (map == NULL) {
+        luaL_error(L, "invalid map file %d", id);
+    }
+
+    return map;
+}
+
 //----------------------------------------------------------------------------------
 // ui.draw_text(text:string, x:int, y:int)
 //----------------------------------------------------------------------------------
@@ -143,25 +196,19 @@ int lua_palset(lua_State *L) {
 
 //----------------------------------------------------------------------------------
 // ui.tile(spritesheet:table, tile_index:int, x:int, y:int)
-// tile_index can have bit 10 (1024) set to flip horizontally
+// tile_index can have bit 10 (1024) set to flip horizontally, bit 11 (2048) to
+// flip vertically and bit 12 (4096) to swap x and y (with the flips, rotations),
+// unless the sheet has more than 1024 tiles
 //----------------------------------------------------------------------------------
 int lua_tile(lua_State *L) {
-    luaL_checktype(L, 1, LUA_TTABLE);
+    SpriteInMemory *sprite_in_memory = check_sprite_in_memory(L, 1);
 
-    lua_getfield(L, 1, "name");
-    const char *name = luaL_checkstring(L, -1);
-    lua_pop(L, 1);
-
-    int tile_index_with_flags = luaL_checkinteger(L, 2);
+    int tile_index, flags;
+    split_tile_value(sprite_in_memory, luaL_checkinteger(L, 2), &tile_index, &flags);
     int x = luaL_checkinteger(L, 3);
     int y = luaL_checkinteger(L, 4);
 
-    bool flipped = (tile_index_with_flags & 1024) != 0;
-    int tile_index = tile_index_with_flags & ~1024;
-
-    SpriteInMemory *sprite_in_memory = get_sprite_in_memory(name);
-
-    add_tile(sprite_in_memory, tile_index, x, y, flipped);
+    add_tile(sprite_in_memory, tile_index, x, y, flags);
 
     return 0;
 }
@@ -170,11 +217,7 @@ int lua_tile(lua_State *L) {
 // ui.spr(spritesheet:table, x:int, y:int, flipped:bool = false)
 //----------------------------------------------------------------------------------
 int lua_spr(lua_State *L) {
-    luaL_checktype(L, 1, LUA_TTABLE);
-
-    lua_getfield(L, 1, "name");
-    const char *name = luaL_checkstring(L, -1);
-    lua_pop(L, 1);
+    SpriteInMemory *sprite_in_memory = check_sprite_in_memory(L, 1);
 
     int x = luaL_checkinteger(L, 2);
     int y = luaL_checkinteger(L, 3);
@@ -184,50 +227,20 @@ int lua_spr(lua_State *L) {
         flipped = lua_toboolean(L, 4);
     }
 
-    SpriteInMemory *sprite_in_memory = get_sprite_in_memory(name);
-
     add_sprite(sprite_in_memory, x, y, flipped);
 
     return 0;
 }
 
-//----------------------------------------------------------------------------------
-// Helper function to get the keyboard key corresponding to a gamepad button
-//----------------------------------------------------------------------------------
-static int get_keyboard_key_for_button(int button) {
-    switch (button) {
-        // D-pad / Arrow keys
-        case GAMEPAD_BUTTON_LEFT_FACE_UP:    return KEY_UP;
-        case GAMEPAD_BUTTON_LEFT_FACE_DOWN:  return KEY_DOWN;
-        case GAMEPAD_BUTTON_LEFT_FACE_LEFT:  return KEY_LEFT;
-        case GAMEPAD_BUTTON_LEFT_FACE_RIGHT: return KEY_RIGHT;
-        // Action buttons
-        case GAMEPAD_BUTTON_RIGHT_FACE_RIGHT: return KEY_Z;  // BTN_Z
-        case GAMEPAD_BUTTON_RIGHT_FACE_DOWN:  return KEY_Z;  // BTN_Z (alternative)
-        case GAMEPAD_BUTTON_RIGHT_FACE_UP:    return KEY_X;  // BTN_Q
-        case GAMEPAD_BUTTON_RIGHT_FACE_LEFT:  return KEY_A;  // BTN_E
-        default: return -1;
-    }
-}
-
 //----------------------------------------------------------------------------------
 // ui.btn(button:int, pad:int) -> bool
-// Checks both gamepad and keyboard input
+// Checks both gamepad and keyboard input, as sampled at the start of the frame
 //----------------------------------------------------------------------------------
 int lua_btn(lua_State *L) {
     int button = luaL_checkinteger(L, 1);
     int pad = luaL_optinteger(L, 2, 0);
 
-    bool is_down = IsGamepadButtonDown(pad, button);
-
-    if (!is_down) {
-        int key = get_keyboard_key_for_button(button);
-        if (key != -1) {
-            is_down = IsKeyDown(key);
-        }
-    }
-
-    lua_pushboolean(L, is_down);
+    lua_pushboolean(L, pad_button_down(pad, button));
 
     return 1;
 }
@@ -240,18 +253,71 @@ int lua_btnp(lua_State *L) {
     int button = luaL_checkinteger(L, 1);
     int pad = luaL_optinteger(L, 2, 0);
 
-    bool is_pressed = IsGamepadButtonPressed(pad, button);
+    lua_pushboolean(L, pad_button_pressed(pad, button));
 
-    if (!is_pressed) {
-        int key = get_keyboard_key_for_button(button);
-        if (key != -1) {
-            is_pressed = IsKeyPressed(key);
+    return 1;
+}
+
+/*
+Controller state tables, one per pad, reused across frames
+*/
+#define CONTROLLER_STATE_PADS 2
+
+static int controller_state_refs[CONTROLLER_STATE_PADS] = { LUA_NOREF, LUA_NOREF };
+static int controller_state_frame = -1;
+
+static const struct {
+    const char *name;
+    int button;
+} controller_state_buttons[] = {
+    { "up", GAMEPAD_BUTTON_LEFT_FACE_UP },
+    { "down", GAMEPAD_BUTTON_LEFT_FACE_DOWN },
+    { "left", GAMEPAD_BUTTON_LEFT_FACE_LEFT },
+    { "right", GAMEPAD_BUTTON_LEFT_FACE_RIGHT },
+    { "a", GAMEPAD_BUTTON_RIGHT_FACE_DOWN },
+    { "b", GAMEPAD_BUTTON_RIGHT_FACE_RIGHT },
+    { "x", GAMEPAD_BUTTON_RIGHT_FACE_LEFT },
+    { "y", GAMEPAD_BUTTON_RIGHT_FACE_UP },
+    { "l", GAMEPAD_BUTTON_LEFT_TRIGGER_1 },
+    { "r", GAMEPAD_BUTTON_RIGHT_TRIGGER_1 },
+    { "select", GAMEPAD_BUTTON_MIDDLE_LEFT },
+    { "start", GAMEPAD_BUTTON_MIDDLE_RIGHT }
+};
+
+//----------------------------------------------------------------------------------
+// sys.get_controller_state() -> pad_1:table, pad_2:table
+// Fields up, down, left, right, a, b, x, y, l, r, select and start hold
+// kState values: 0 idle, 1 held, 2 pressed this frame. The same two tables
+// are returned every call and refreshed once per frame.
+//----------------------------------------------------------------------------------
+int lua_get_controller_state(lua_State *L) {
+    int count = sizeof(controller_state_buttons) / sizeof(controller_state_buttons[0]);
+    bool refresh = controller_state_frame != input_snapshot.frame;
+
+    for (int pad = 0; pad < CONTROLLER_STATE_PADS; pad++) {
+        if (controller_state_refs[pad] == LUA_NOREF) {
+            lua_createtable(L, 0, count);
+            controller_state_refs[pad] = luaL_ref(L, LUA_REGISTRYINDEX);
+            refresh = true;
         }
     }
 
-    lua_pushboolean(L, is_pressed);
+    for (int pad = 0; pad < CONTROLLER_STATE_PADS; pad++) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, controller_state_refs[pad]);
+        if (!refresh) continue;
 
-    return 1;
+        for (int i = 0; i < count; i++) {
+            int button = controller_state_buttons[i].button;
+            int state = pad_button_pressed(pad, button) ? 2 : (pad_button_down(pad, button) ? 1 : 0);
+
+            lua_pushinteger(L, state);
+            lua_setfield(L, -2, controller_state_buttons[i].name);
+        }
+    }
+
+    controller_state_frame = input_snapshot.frame;
+
+    return CONTROLLER_STATE_PADS;
 }
 
 //----------------------------------------------------------------------------------
@@ -296,6 +362,1066 @@ int lua_fillp(lua_State *L) {
     return 0;
 }
 
+//----------------------------------------------------------------------------------
+// ui.begin_list() -> list:int
+// Records the following ui.* draw calls into a display list instead of the frame
+//----------------------------------------------------------------------------------
+int lua_begin_list(lua_State *L) {
+    int id = begin_display_list();
+    if (id == 0) {
+        return luaL_error(L, "ui.begin_list: a display list is already being recorded");
+    }
+
+    lua_pushinteger(L, id);
+
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// ui.end_list()
+//----------------------------------------------------------------------------------
+int lua_end_list(lua_State *L) {
+    end_display_list();
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.call_list(list:int, dx:int = 0, dy:int = 0)
+//----------------------------------------------------------------------------------
+int lua_call_list(lua_State *L) {
+    int id = luaL_checkinteger(L, 1);
+    int dx = luaL_optinteger(L, 2, 0);
+    int dy = luaL_optinteger(L, 3, 0);
+
+    DisplayList *list = get_display_list(id);
+    if (list == NULL) {
+        return luaL_error(L, "ui.call_list: invalid display list %d", id);
+    }
+
+    // It would replay itself forever
+    if (is_recording_display_list(list)) {
+        return luaL_error(L, "ui.call_list: display list %d is being recorded", id);
+    }
+
+    add_call_list(id, dx, dy);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.delete_list(list:int)
+//----------------------------------------------------------------------------------
+int lua_delete_list(lua_State *L) {
+    int id = luaL_checkinteger(L, 1);
+
+    delete_display_list(id);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.tilemap(data:table|map_file:int, layer:int = 1, tile_size:int = 16) -> map:int
+// Copies one layer of a map table (data[y][x][layer]) or of a map file opened
+// with ui.map_open into a cached C tile map
+//----------------------------------------------------------------------------------
+int lua_tilemap(lua_State *L) {
+    int layer = luaL_optinteger(L, 2, 1);
+    int tile_size = luaL_optinteger(L, 3, 16);
+
+    if (lua_isinteger(L, 1)) {
+        MapFile *map_file = check_map_file(L, 1);
+        lua_pushinteger(L, map_file_to_tilemap(map_file, layer - 1, tile_size));
+        return 1;
+    }
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+
+    // Rows and cells may be sparse, so the size comes from the largest keys
+    int width = 0, height = 0;
+    lua_pushnil(L);
+    while (lua_next(L, 1) != 0) {
+        if (lua_isinteger(L, -2) && lua_istable(L, -1)) {
+            int y = lua_tointeger(L, -2);
+            if (y > height) height = y;
+
+            lua_pushnil(L);
+            while (lua_next(L, -2) != 0) {
+                if (lua_isinteger(L, -2)) {
+                    int x = lua_tointeger(L, -2);
+                    if (x > width) width = x;
+                }
+                lua_pop(L, 1);
+            }
+        }
+        lua_pop(L, 1);
+    }
+
+    int id = create_tilemap(width, height, tile_size);
+    TileMap *map = get_tilemap(id);
+
+    lua_pushnil(L);
+    while (lua_next(L, 1) != 0) {
+        if (lua_isinteger(L, -2) && lua_istable(L, -1)) {
+            int y = lua_tointeger(L, -2);
+
+            lua_pushnil(L);
+            while (lua_next(L, -2) != 0) {
+                if (lua_isinteger(L, -2) && lua_istable(L, -1)) {
+                    int x = lua_tointeger(L, -2);
+
+                    lua_geti(L, -1, layer);
+                    if (lua_isinteger(L, -1)) {
+                        tilemap_set(map, x - 1, y - 1, (uint16_t) lua_tointeger(L, -1));
+                    }
+                    lua_pop(L, 1);
+                }
+                lua_pop(L, 1);
+            }
+        }
+        lua_pop(L, 1);
+    }
+
+    lua_pushinteger(L, id);
+
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// ui.map_open(path:string) -> map_file:int
+// Opens a binary map (.lmap); only its header stays in memory
+//----------------------------------------------------------------------------------
+int lua_map_open(lua_State *L) {
+    const char *path = luaL_checkstring(L, 1);
+
+    int id = open_map_file(path);
+    if (id == 0) {
+        return luaL_error(L, "ui.map_open: can't read map file %s", path);
+    }
+
+    lua_pushinteger(L, id);
+
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// ui.map_size(map_file:int) -> width:int, height:int
+// Size in tiles
+//----------------------------------------------------------------------------------
+int lua_map_size(lua_State *L) {
+    MapFile *map = check_map_file(L, 1);
+
+    lua_pushinteger(L, map->width);
+    lua_pushinteger(L, map->height);
+
+    return 2;
+}
+
+//----------------------------------------------------------------------------------
+// ui.map_get(map_file:int, x:int, y:int, layer:int) -> value:int|nil
+// 1-based like map tables; empty cells and cells outside the map give nil
+//----------------------------------------------------------------------------------
+int lua_map_get(lua_State *L) {
+    MapFile *map = check_map_file(L, 1);
+    int x = luaL_checkinteger(L, 2);
+    int y = luaL_checkinteger(L, 3);
+    int layer = luaL_checkinteger(L, 4);
+
+    uint16_t value = map_file_get(map, layer - 1, x - 1, y - 1);
+    if (value == 0) {
+        lua_pushnil(L);
+    } else {
+        lua_pushinteger(L, value);
+    }
+
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// ui.map_stream(map_file:int, camx:int, camy:int, tile_size:int = 16)
+// Keeps the chunks around the camera decoded and frees the others
+//----------------------------------------------------------------------------------
+int lua_map_stream(lua_State *L) {
+    MapFile *map = check_map_file(L, 1);
+    int camx = luaL_checkinteger(L, 2);
+    int camy = luaL_checkinteger(L, 3);
+    int tile_size = luaL_optinteger(L, 4, 16);
+
+    map_file_stream(map, camx, camy, tile_size);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.map_cells(map_file:int, layer:int) -> { {x=, y=, value=}, ... }
+// Every non-empty cell of a layer, row by row (1-based coordinates)
+//----------------------------------------------------------------------------------
+int lua_map_cells(lua_State *L) {
+    MapFile *map = check_map_file(L, 1);
+    int layer = luaL_checkinteger(L, 2) - 1;
+
+    lua_newtable(L);
+    if (layer < 0 || layer >= map->layers) return 1;
+
+    // One row of chunks is decoded at a time so cells come out row by row
+    int chunk_cells = map->chunk_size * map->chunk_size;
+    int chunk_values = map->layers * chunk_cells;
+    uint16_t *scratch = (uint16_t *) malloc(sizeof(uint16_t) * chunk_values * map->chunks_x);
+    const uint16_t **chunk_row = (const uint16_t **) malloc(sizeof(uint16_t *) * map->chunks_x);
+    int count = 0;
+
+    for (int cy = 0; cy < map->chunks_y; cy++) {
+        for (int cx = 0; cx < map->chunks_x; cx++) {
+            chunk_row[cx] = map_file_peek_chunk(map, cx, cy, scratch + cx * chunk_values) + layer * chunk_cells;
+        }
+
+        for (int y = cy * map->chunk_size; y < (cy + 1) * map->chunk_size && y < map->height; y++) {
+            for (int x = 0; x < map->width; x++) {
+                uint16_t value = chunk_row[x / map->chunk_size][(y % map->chunk_size) * map->chunk_size + x % map->chunk_size];
+                if (value == 0) continue;
+
+                lua_createtable(L, 0, 3);
+                lua_pushinteger(L, x + 1);
+                lua_setfield(L, -2, "x");
+                lua_pushinteger(L, y + 1);
+                lua_setfield(L, -2, "y");
+                lua_pushinteger(L, value);
+                lua_setfield(L, -2, "value");
+                lua_rawseti(L, -2, ++count);
+            }
+        }
+    }
+
+    free(chunk_row);
+    free(scratch);
+
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// ui.map_close(map_file:int)
+//----------------------------------------------------------------------------------
+int lua_map_close(lua_State *L) {
+    close_map_file(luaL_checkinteger(L, 1));
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.tilemap_draw(map:int, spritesheet:table, camx:int, camy:int)
+//----------------------------------------------------------------------------------
+int lua_tilemap_draw(lua_State *L) {
+    int id = luaL_checkinteger(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    int camx = luaL_checkinteger(L, 3);
+    int camy = luaL_checkinteger(L, 4);
+
+    TileMap *map = get_tilemap(id);
+    if (map == NULL) {
+        return luaL_error(L, "ui.tilemap_draw: invalid tile map %d", id);
+    }
+
+    add_tilemap(map, check_sprite_in_memory(L, 2), camx, camy);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.tilemap_set(map:int, x:int, y:int, tile:int)
+// x and y are 1-based like the map table; only the chunk holding the tile is rebuilt
+//----------------------------------------------------------------------------------
+int lua_tilemap_set(lua_State *L) {
+    int id = luaL_checkinteger(L, 1);
+    int x = luaL_checkinteger(L, 2);
+    int y = luaL_checkinteger(L, 3);
+    int tile = luaL_optinteger(L, 4, 0);
+
+    TileMap *map = get_tilemap(id);
+    if (map == NULL) {
+        return luaL_error(L, "ui.tilemap_set: invalid tile map %d", id);
+    }
+
+    tilemap_set(map, x - 1, y - 1, (uint16_t) tile);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.tilemap_free(map:int)
+//----------------------------------------------------------------------------------
+int lua_tilemap_free(lua_State *L) {
+    int id = luaL_checkinteger(L, 1);
+
+    delete_tilemap(id);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.bg_layer(layer:int, spritesheet:table, pattern:table, y:int,
+//             scroll_x:number, scroll_y:number = 0, max_scroll_y:int = 0)
+// Assigns a background plane; pattern is the row of tile indexes repeated across it
+//----------------------------------------------------------------------------------
+int lua_bg_layer(lua_State *L) {
+    int layer = luaL_checkinteger(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    luaL_checktype(L, 3, LUA_TTABLE);
+    int y = luaL_checkinteger(L, 4);
+    float scroll_x = luaL_checknumber(L, 5);
+    float scroll_y = luaL_optnumber(L, 6, 0);
+    int max_scroll_y = luaL_optinteger(L, 7, 0);
+
+    if (layer < 1 || layer > MAX_BG_LAYERS) {
+        return luaL_error(L, "ui.bg_layer: layer must be between 1 and %d", MAX_BG_LAYERS);
+    }
+
+    SpriteInMemory *tileset = check_sprite_in_memory(L, 2);
+
+    int pattern_length = luaL_len(L, 3);
+    uint16_t *pattern = (uint16_t *) malloc(sizeof(uint16_t) * pattern_length);
+    for (int i = 0; i < pattern_length; i++) {
+        lua_geti(L, 3, i + 1);
+        pattern[i] = (uint16_t) lua_tointeger(L, -1);
+        lua_pop(L, 1);
+    }
+
+    set_bg_layer(layer - 1, tileset, pattern, pattern_length, y, scroll_x, scroll_y, max_scroll_y);
+    free(pattern);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.bg_draw(layer:int, camx:int, camy:int)
+//----------------------------------------------------------------------------------
+int lua_bg_draw(lua_State *L) {
+    int layer = luaL_checkinteger(L, 1);
+    int camx = luaL_checkinteger(L, 2);
+    int camy = luaL_checkinteger(L, 3);
+
+    add_bg_layer(layer - 1, camx, camy);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.tile_anim(spritesheet:table, tile_index:int, frames:table, cadency:int)
+// Animates a tile through the given tile indexes, cadency frames each
+//----------------------------------------------------------------------------------
+int lua_tile_anim(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    int tile_index = luaL_checkinteger(L, 2);
+    luaL_checktype(L, 3, LUA_TTABLE);
+    int cadency = luaL_checkinteger(L, 4);
+
+    SpriteInMemory *sprite_in_memory = check_sprite_in_memory(L, 1);
+    if (sprite_in_memory == NULL) {
+        return luaL_error(L, "ui.tile_anim: spritesheet is not loaded");
+    }
+
+    int frame_count = luaL_len(L, 3);
+    uint16_t *frames = (uint16_t *) malloc(sizeof(uint16_t) * frame_count);
+    for (int i = 0; i < frame_count; i++) {
+        lua_geti(L, 3, i + 1);
+        frames[i] = (uint16_t) lua_tointeger(L, -1);
+        lua_pop(L, 1);
+    }
+
+    set_tile_anim(sprite_in_memory, tile_index, frames, frame_count, cadency);
+    free(frames);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.tile_anim_sheets(spritesheet:table, frame_sheets:table, cadency:int)
+// Folds whole-sheet animation frames into per-tile animations of spritesheet,
+// which becomes the first frame. The frame sheets are released.
+//----------------------------------------------------------------------------------
+int lua_tile_anim_sheets(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    int cadency = luaL_checkinteger(L, 3);
+
+    SpriteInMemory *base = check_sprite_in_memory(L, 1);
+    if (base == NULL || base->data == NULL) {
+        return luaL_error(L, "ui.tile_anim_sheets: spritesheet is not loaded");
+    }
+
+    int sheet_count = luaL_len(L, 2);
+    SpriteInMemory **sheets = (SpriteInMemory **) malloc(sizeof(SpriteInMemory *) * sheet_count);
+    for (int i = 0; i < sheet_count; i++) {
+        lua_geti(L, 2, i + 1);
+        sheets[i] = check_sprite_in_memory(L, -1);
+        lua_pop(L, 1);
+
+        bool compatible = sheets[i] != NULL && sheets[i]->data != NULL
+            && sheets[i]->tile_width == base->tile_width
+            && sheets[i]->tile_height == base->tile_height
+            && sheets[i]->ntiles >= base->ntiles;
+
+        if (!compatible) {
+            free(sheets);
+            return luaL_error(L, "ui.tile_anim_sheets: frame %d does not match spritesheet %s", i + 1, base->name);
+        }
+    }
+
+    merge_tile_anim_sheets(base, sheets, sheet_count, cadency);
+    free(sheets);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.preload_spritesheet(spritesheet:table)
+// Queues the sheet's texture upload ahead of its first draw
+//----------------------------------------------------------------------------------
+int lua_preload_spritesheet(lua_State *L) {
+    preload_sprite_in_memory(check_sprite_in_memory(L, 1));
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.begin_assets(name:string)
+// Sheets drawn and tilemaps/lists created from now on belong to the named group
+//----------------------------------------------------------------------------------
+int lua_begin_assets(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+
+    begin_asset_group(name);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.release_assets(name:string)
+// Frees the group's textures, sheet data, tilemaps and lists at the end of the frame
+//----------------------------------------------------------------------------------
+int lua_release_assets(lua_State *L) {
+    const char *name = luaL_checkstring(L, 1);
+
+    release_asset_group(name);
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// sys.texture_budget([bytes:int]) -> int
+// Sets the resident sheet texture budget (0 disables eviction); returns the budget
+//----------------------------------------------------------------------------------
+int lua_texture_budget(lua_State *L) {
+    if (!lua_isnoneornil(L, 1)) {
+        texture_stats.budget_bytes = luaL_checkinteger(L, 1);
+    }
+
+    lua_pushinteger(L, texture_stats.budget_bytes);
+
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// sys.stats() -> table
+// Engine counters; rates cover the last full second
+//----------------------------------------------------------------------------------
+int lua_stats(lua_State *L) {
+    lua_newtable(L);
+
+    lua_pushinteger(L, texture_stats.resident_bytes);
+    lua_setfield(L, -2, "texture_bytes");
+
+    lua_pushinteger(L, texture_stats.budget_bytes);
+    lua_setfield(L, -2, "texture_budget");
+
+    lua_pushinteger(L, texture_stats.evictions_per_sec);
+    lua_setfield(L, -2, "evictions_per_sec");
+
+    lua_pushinteger(L, texture_stats.reloads_per_sec);
+    lua_setfield(L, -2, "reloads_per_sec");
+
+    lua_pushinteger(L, map_chunks_resident);
+    lua_setfield(L, -2, "map_chunks");
+
+    lua_pushinteger(L, lua_memory_in_use());
+    lua_setfield(L, -2, "lua_bytes");
+
+    lua_pushinteger(L, lua_memory.pool_bytes);
+    lua_setfield(L, -2, "lua_pool_bytes");
+
+    lua_pushinteger(L, lua_memory.large_bytes);
+    lua_setfield(L, -2, "lua_large_bytes");
+
+    // One entry per size class
+    lua_createtable(L, LUA_POOL_CLASSES, 0);
+    for (int i = 0; i < LUA_POOL_CLASSES; i++) {
+        LuaPoolClass *pool = &lua_memory.classes[i];
+
+        lua_createtable(L, 0, 4);
+        lua_pushinteger(L, pool->block_size);
+        lua_setfield(L, -2, "size");
+        lua_pushinteger(L, pool->used);
+        lua_setfield(L, -2, "used");
+        lua_pushinteger(L, pool->free);
+        lua_setfield(L, -2, "free");
+        lua_pushinteger(L, pool->allocations);
+        lua_setfield(L, -2, "allocations");
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_setfield(L, -2, "lua_pools");
+
+    lua_pushnumber(L, lua_gc_state.frame_ms);
+    lua_setfield(L, -2, "gc_ms");
+
+    lua_pushinteger(L, lua_gc_state.steps);
+    lua_setfield(L, -2, "gc_steps");
+
+    lua_pushinteger(L, lua_gc_state.cycles);
+    lua_setfield(L, -2, "gc_cycles");
+
+    lua_pushinteger(L, bytecode_chunks_loaded);
+    lua_setfield(L, -2, "bytecode_chunks");
+
+    lua_pushinteger(L, source_chunks_loaded);
+    lua_setfield(L, -2, "source_chunks");
+
+    lua_pushinteger(L, input_queue.total);
+    lua_setfield(L, -2, "input_events");
+
+    lua_pushinteger(L, input_queue.dropped);
+    lua_setfield(L, -2, "input_dropped");
+
+    lua_pushnumber(L, input_queue.latency_ms);
+    lua_setfield(L, -2, "input_latency_ms");
+
+    lua_pushnumber(L, input_queue.max_latency_ms);
+    lua_setfield(L, -2, "input_max_latency_ms");
+
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// sys.gc_collect()
+// Full collection spread over the next frames instead of collectgarbage("collect")
+//----------------------------------------------------------------------------------
+int lua_gc_collect(lua_State *L) {
+    request_lua_collect();
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// sys.alloc_profile(enabled:boolean)
+// Starts a fresh allocation profile, or stops the current one keeping its sites
+//----------------------------------------------------------------------------------
+int lua_alloc_profile(lua_State *L) {
+    if (lua_toboolean(L, 1)) {
+        start_alloc_profile(L);
+    } else {
+        stop_alloc_profile(L);
+    }
+
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// sys.alloc_report([count:int]) -> table
+// Prints and returns the top allocating lines: {source, line, bytes_per_frame,
+// allocs_per_frame, last_bytes, last_allocs}, averaged over the profiled frames
+//----------------------------------------------------------------------------------
+int lua_alloc_report(lua_State *L) {
+    int limit = luaL_optinteger(L, 1, 10);
+    int frames = alloc_profile.frames > 0 ? alloc_profile.frames : 1;
+
+    // Building the result allocates; it would be charged to the calling line
+    // and could grow the site table under the sorted pointers. The next line
+    // event sets the site again.
+    alloc_profile.current_key = NULL;
+
+    int count;
+    AllocSite **sites = sorted_alloc_sites(&count);
+    if (count > limit) count = limit;
+
+    printf("Lua allocations over %d frames:\n", alloc_profile.frames);
+    lua_createtable(L, count, 0);
+    bool stripped = false;
+
+    for (int i = 0; i < count; i++) {
+        AllocSite *site = sites[i];
+        double bytes = site->total_bytes / frames;
+        double allocs = site->total_count / frames;
+
+        printf("%10.0f B/frame %8.1f allocs/frame  %s:%d\n", bytes, allocs, site->source, site->line);
+
+        // Chunks loaded from stripped bytecode report no source or line
+        if (site->line < 0 && strcmp(site->source, "?") == 0) stripped = true;
+
+        lua_createtable(L, 0, 6);
+        lua_pushstring(L, site->source);
+        lua_setfield(L, -2, "source");
+        lua_pushinteger(L, site->line);
+        lua_setfield(L, -2, "line");
+        lua_pushnumber(L, bytes);
+        lua_setfield(L, -2, "bytes_per_frame");
+        lua_pushnumber(L, allocs);
+        lua_setfield(L, -2, "allocs_per_frame");
+        lua_pushinteger(L, site->last_bytes);
+        lua_setfield(L, -2, "last_bytes");
+        lua_pushinteger(L, site->last_count);
+        lua_setfield(L, -2, "last_allocs");
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    if (stripped) {
+        printf("?:-1 is code loaded from stripped bytecode; build with BYTECODE_STRIP=0 to see its lines\n");
+    }
+
+    free(sites);
+
+    return 1;
+}
+
+/**
+Boxes: Rectangle userdata for collision code that shouldn't produce garbage
+**/
+#define BOX_METATABLE "lupi.box"
+#define BOX_SCRATCH_KEY "lupi.box_scratch"
+
+static int box_scratch_next = 0;
+
+static Rectangle* check_box(lua_State *L, int index) {
+    return (Rectangle *) luaL_checkudata(L, index, BOX_METATABLE);
+}
+
+static Rectangle* push_box(lua_State *L) {
+    Rectangle *box = (Rectangle *) lua_newuserdatauv(L, sizeof(Rectangle), 0);
+    luaL_setmetatable(L, BOX_METATABLE);
+    return box;
+}
+
+static void set_box(lua_State *L, Rectangle *box, int first) {
+    box->x = luaL_optnumber(L, first, 0);
+    box->y = luaL_optnumber(L, first + 1, 0);
+    box->width = luaL_optnumber(L, first + 2, 0);
+    box->height = luaL_optnumber(L, first + 3, 0);
+}
+
+// Whole values come back as integers, like the tables boxes replace
+static void push_box_value(lua_State *L, float value) {
+    if (value == (float) (lua_Integer) value) {
+        lua_pushinteger(L, (lua_Integer) value);
+    } else {
+        lua_pushnumber(L, value);
+    }
+}
+
+static float* box_field(Rectangle *box, const char *key) {
+    if (strcmp(key, "x") == 0) return &box->x;
+    if (strcmp(key, "y") == 0) return &box->y;
+    if (strcmp(key, "width") == 0) return &box->width;
+    if (strcmp(key, "height") == 0) return &box->height;
+    return NULL;
+}
+
+static int box_index(lua_State *L) {
+    Rectangle *box = check_box(L, 1);
+    const char *key = luaL_checkstring(L, 2);
+
+    float *field = box_field(box, key);
+    if (field != NULL) {
+        push_box_value(L, *field);
+        return 1;
+    }
+
+    // Methods live in the metatable
+    lua_getmetatable(L, 1);
+    lua_getfield(L, -1, key);
+    return 1;
+}
+
+static int box_newindex(lua_State *L) {
+    Rectangle *box = check_box(L, 1);
+    const char *key = luaL_checkstring(L, 2);
+
+    float *field = box_field(box, key);
+    if (field == NULL) {
+        return luaL_error(L, "box has no field '%s'", key);
+    }
+
+    *field = luaL_checknumber(L, 3);
+    return 0;
+}
+
+static int box_tostring(lua_State *L) {
+    Rectangle *box = check_box(L, 1);
+    lua_pushfstring(L, "box(%f, %f, %f, %f)", box->x, box->y, box->width, box->height);
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// box:set(x:number, y:number, width:number, height:number) -> box
+//----------------------------------------------------------------------------------
+static int box_set(lua_State *L) {
+    set_box(L, check_box(L, 1), 2);
+    lua_settop(L, 1);
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// box:move(dx:number, dy:number) -> box
+//----------------------------------------------------------------------------------
+static int box_move(lua_State *L) {
+    Rectangle *box = check_box(L, 1);
+    box->x += luaL_checknumber(L, 2);
+    box->y += luaL_checknumber(L, 3);
+    lua_settop(L, 1);
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// box:overlaps(other:box) -> bool
+// Touching edges don't overlap, as with check_collision()
+//----------------------------------------------------------------------------------
+static int box_overlaps(lua_State *L) {
+    lua_pushboolean(L, CheckCollisionRecs(*check_box(L, 1), *check_box(L, 2)));
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// box:intersect(other:box) -> bool
+// Shrinks box to the overlap with other; false, leaving box unchanged, if none
+//----------------------------------------------------------------------------------
+static int box_intersect(lua_State *L) {
+    Rectangle *box = check_box(L, 1);
+    Rectangle *other = check_box(L, 2);
+
+    if (!CheckCollisionRecs(*box, *other)) {
+        lua_pushboolean(L, false);
+        return 1;
+    }
+
+    *box = GetCollisionRec(*box, *other);
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// box:unpack() -> x, y, width, height
+//----------------------------------------------------------------------------------
+static int box_unpack(lua_State *L) {
+    Rectangle *box = check_box(L, 1);
+    push_box_value(L, box->x);
+    push_box_value(L, box->y);
+    push_box_value(L, box->width);
+    push_box_value(L, box->height);
+    return 4;
+}
+
+void open_box_type(lua_State *L) {
+    static const luaL_Reg box_methods[] = {
+        {"__index", box_index},
+        {"__newindex", box_newindex},
+        {"__tostring", box_tostring},
+        {"set", box_set},
+        {"move", box_move},
+        {"overlaps", box_overlaps},
+        {"intersect", box_intersect},
+        {"unpack", box_unpack},
+        {NULL, NULL}
+    };
+
+    luaL_newmetatable(L, BOX_METATABLE);
+    luaL_setfuncs(L, box_methods, 0);
+    lua_pop(L, 1);
+
+    lua_newtable(L);
+    lua_setfield(L, LUA_REGISTRYINDEX, BOX_SCRATCH_KEY);
+}
+
+//----------------------------------------------------------------------------------
+// Scratch boxes handed out this frame become free again
+//----------------------------------------------------------------------------------
+void reset_box_scratch() {
+    box_scratch_next = 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.box(x:number, y:number, width:number, height:number) -> box
+// A box to keep and update with box:set() instead of building a table per call
+//----------------------------------------------------------------------------------
+int lua_box(lua_State *L) {
+    set_box(L, push_box(L), 1);
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// ui.box_scratch(x:number, y:number, width:number, height:number) -> box
+// A box from a pool that is reused every frame: only valid until the frame ends
+//----------------------------------------------------------------------------------
+int lua_box_scratch(lua_State *L) {
+    lua_getfield(L, LUA_REGISTRYINDEX, BOX_SCRATCH_KEY);
+
+    box_scratch_next++;
+    if (lua_rawgeti(L, -1, box_scratch_next) == LUA_TNIL) {
+        lua_pop(L, 1);
+        push_box(L);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, -3, box_scratch_next);
+    }
+
+    set_box(L, check_box(L, -1), 1);
+    return 1;
+}
+
+/**
+Spatial Hashes
+**/
+static int *spatial_results = NULL;
+static int spatial_results_max = 0;
+
+static SpatialHash* check_spatial_hash(lua_State *L, int index) {
+    int id = luaL_checkinteger(L, index);
+    SpatialHash *hash = get_spatial_hash(id);
+
+    if (hash == NULL) {
+        luaL_error(L, "invalid spatial hash %d", id);
+    }
+
+    return hash;
+}
+
+//----------------------------------------------------------------------------------
+// ui.spatial(cell_size:int = 16) -> grid:int
+//----------------------------------------------------------------------------------
+int lua_spatial(lua_State *L) {
+    lua_pushinteger(L, create_spatial_hash(luaL_optinteger(L, 1, 16)));
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// ui.spatial_set(grid:int, id:int, box:box)
+// Registers entity id (>= 1) at box, or moves it there
+//----------------------------------------------------------------------------------
+int lua_spatial_set(lua_State *L) {
+    SpatialHash *hash = check_spatial_hash(L, 1);
+    int entity = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, entity >= 1, 2, "entity ids start at 1");
+
+    spatial_hash_set(hash, entity, *check_box(L, 3));
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.spatial_remove(grid:int, id:int)
+//----------------------------------------------------------------------------------
+int lua_spatial_remove(lua_State *L) {
+    spatial_hash_remove(check_spatial_hash(L, 1), luaL_checkinteger(L, 2));
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.spatial_query(grid:int, box:box, out:table) -> count:int
+// Fills out[1..count] with the ids overlapping box, ascending, and clears the
+// rest of out, so one table can be reused every frame
+//----------------------------------------------------------------------------------
+int lua_spatial_query(lua_State *L) {
+    SpatialHash *hash = check_spatial_hash(L, 1);
+    Rectangle *box = check_box(L, 2);
+    luaL_checktype(L, 3, LUA_TTABLE);
+
+    int count = spatial_hash_query(hash, *box, &spatial_results, &spatial_results_max);
+    int previous = (int) lua_rawlen(L, 3);
+
+    for (int i = 0; i < count; i++) {
+        lua_pushinteger(L, spatial_results[i]);
+        lua_rawseti(L, 3, i + 1);
+    }
+
+    for (int i = count + 1; i <= previous; i++) {
+        lua_pushnil(L);
+        lua_rawseti(L, 3, i);
+    }
+
+    lua_pushinteger(L, count);
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// ui.spatial_free(grid:int)
+//----------------------------------------------------------------------------------
+int lua_spatial_free(lua_State *L) {
+    delete_spatial_hash(luaL_checkinteger(L, 1));
+    return 0;
+}
+
+/**
+Particle Emitters
+**/
+static ParticleEmitter* check_emitter(lua_State *L, int index) {
+    int id = luaL_checkinteger(L, index);
+    ParticleEmitter *emitter = get_emitter(id);
+
+    if (emitter == NULL) {
+        luaL_error(L, "invalid emitter %d", id);
+    }
+
+    return emitter;
+}
+
+static float opt_number_field(lua_State *L, int index, const char *key, float fallback) {
+    lua_getfield(L, index, key);
+    float value = luaL_optnumber(L, -1, fallback);
+    lua_pop(L, 1);
+    return value;
+}
+
+//----------------------------------------------------------------------------------
+// ui.emitter(settings:table) -> emitter:int
+// settings: rate (particles per frame), lifetime (frames, 0 = until shrunk),
+// size, shrink (per frame), vx, vy, spread_x, spread_y, gravity,
+// colors (palette ramp over the lifetime), max (live particles)
+//----------------------------------------------------------------------------------
+int lua_emitter(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+
+    EmitterSettings settings;
+    settings.rate = opt_number_field(L, 1, "rate", 1);
+    settings.lifetime = (int) opt_number_field(L, 1, "lifetime", 0);
+    settings.size = opt_number_field(L, 1, "size", 1);
+    settings.shrink = opt_number_field(L, 1, "shrink", 0);
+    settings.vx = opt_number_field(L, 1, "vx", 0);
+    settings.vy = opt_number_field(L, 1, "vy", 0);
+    settings.spread_x = opt_number_field(L, 1, "spread_x", 0);
+    settings.spread_y = opt_number_field(L, 1, "spread_y", 0);
+    settings.gravity = opt_number_field(L, 1, "gravity", 0);
+    int max_particles = (int) opt_number_field(L, 1, "max", 64);
+
+    settings.ramp_count = 0;
+    if (lua_getfield(L, 1, "colors") == LUA_TTABLE) {
+        int count = (int) lua_rawlen(L, -1);
+        for (int i = 1; i <= count && settings.ramp_count < MAX_EMITTER_RAMP; i++) {
+            lua_rawgeti(L, -1, i);
+            settings.ramp[settings.ramp_count++] = luaL_checkinteger(L, -1);
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+
+    lua_pushinteger(L, create_emitter(settings, max_particles));
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// ui.emitter_at(emitter:int, x:number, y:number)
+// Spawns at the world position this frame; frames it isn't placed spawn nothing
+//----------------------------------------------------------------------------------
+int lua_emitter_at(lua_State *L) {
+    ParticleEmitter *emitter = check_emitter(L, 1);
+    emitter_at(emitter, luaL_checknumber(L, 2), luaL_checknumber(L, 3));
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.emitter_draw(emitter:int, camx:int, camy:int)
+// Draws the particles and advances them one frame
+//----------------------------------------------------------------------------------
+int lua_emitter_draw(lua_State *L) {
+    ParticleEmitter *emitter = check_emitter(L, 1);
+    emitter_step(emitter, luaL_checkinteger(L, 2), luaL_checkinteger(L, 3));
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// ui.emitter_free(emitter:int)
+//----------------------------------------------------------------------------------
+int lua_emitter_free(lua_State *L) {
+    delete_emitter(luaL_checkinteger(L, 1));
+    return 0;
+}
+
+/**
+Kinematic Bodies
+**/
+//----------------------------------------------------------------------------------
+// ui.body(map_file:int, layer:int, solids:table, settings:table) -> body:int
+// solids maps collision values to the kColisionType sides they block, as
+// kColisionTile does. settings: width, height (32), gravity, max_fall,
+// foot_inset (4), head (12), side_inset (6), side_reach (18), tile_size (16)
+//----------------------------------------------------------------------------------
+int lua_body(lua_State *L) {
+    KinematicBody body;
+    body.map_file = luaL_checkinteger(L, 1);
+    body.layer = luaL_checkinteger(L, 2) - 1;
+    luaL_checktype(L, 3, LUA_TTABLE);
+    luaL_checktype(L, 4, LUA_TTABLE);
+
+    body.solid_count = 0;
+    lua_pushnil(L);
+    while (lua_next(L, 3) != 0) {
+        if (body.solid_count < MAX_BODY_SOLIDS && lua_isinteger(L, -2) && lua_istable(L, -1)) {
+            BodySolid *solid = &body.solids[body.solid_count++];
+            solid->value = (uint16_t) lua_tointeger(L, -2);
+            solid->sides = 0;
+
+            int count = (int) lua_rawlen(L, -1);
+            for (int i = 1; i <= count; i++) {
+                lua_rawgeti(L, -1, i);
+                int side = (int) lua_tointeger(L, -1);
+                if (side >= 1 && side <= 4) solid->sides |= 1 << (side - 1);
+                lua_pop(L, 1);
+            }
+        }
+        lua_pop(L, 1);
+    }
+
+    body.width = opt_number_field(L, 4, "width", 32);
+    body.height = opt_number_field(L, 4, "height", 32);
+    body.gravity = opt_number_field(L, 4, "gravity", 0);
+    body.max_fall = opt_number_field(L, 4, "max_fall", INFINITY);
+    body.foot_inset = opt_number_field(L, 4, "foot_inset", 4);
+    body.head = opt_number_field(L, 4, "head", 12);
+    body.side_inset = opt_number_field(L, 4, "side_inset", 6);
+    body.side_reach = opt_number_field(L, 4, "side_reach", 18);
+    body.tile_size = (int) opt_number_field(L, 4, "tile_size", 16);
+
+    lua_pushinteger(L, create_body(body));
+    return 1;
+}
+
+//----------------------------------------------------------------------------------
+// ui.body_step(body:int, x:number, y:number, vx:number, vy:number)
+//     -> x:number, y:number, vx:number, vy:number, contacts:int
+// Applies gravity and velocity and resolves against the map in one call;
+// contacts has CONTACT_GROUND, CONTACT_CEILING, CONTACT_LEFT and CONTACT_RIGHT bits
+//----------------------------------------------------------------------------------
+int lua_body_step(lua_State *L) {
+    int id = luaL_checkinteger(L, 1);
+    KinematicBody *body = get_body(id);
+    if (body == NULL) {
+        return luaL_error(L, "invalid body %d", id);
+    }
+
+    double x = luaL_checknumber(L, 2);
+    double y = luaL_checknumber(L, 3);
+    double vx = luaL_checknumber(L, 4);
+    double vy = luaL_checknumber(L, 5);
+
+    int contacts = body_step(body, &x, &y, &vx, &vy);
+
+    lua_pushnumber(L, x);
+    lua_pushnumber(L, y);
+    lua_pushnumber(L, vx);
+    lua_pushnumber(L, vy);
+    lua_pushinteger(L, contacts);
+    return 5;
+}
+
+//----------------------------------------------------------------------------------
+// ui.body_free(body:int)
+//----------------------------------------------------------------------------------
+int lua_body_free(lua_State *L) {
+    delete_body(luaL_checkinteger(L, 1));
+    return 0;
+}
 
 // TODO
 
@@ -321,15 +1447,6 @@ int lua_clip(lua_State *L) {
     return 0;
 }
 
-//----------------------------------------------------------------------------------
-// ui.preload_spritesheet(spritesheet)
-//----------------------------------------------------------------------------------
-int lua_preload_spritesheet(lua_State *L) {
-    int spritesheet = luaL_checkinteger(L, 1);
-
-    return 0;
-}
-
 //----------------------------------------------------------------------------------
 // ui.draw_sprite(x, y, sprite_index, size)
 //----------------------------------------------------------------------------------
@@ -399,7 +1516,12 @@ void load_sprites_in_memory_from_lua(lua_State *L) {
         int ntiles = luaL_checkinteger(L, -1);
         lua_pop(L, 1);
 
-        add_sprite_in_memory(name, data, width, height, ntiles);
+        // Optional; without it the loader picks a square-ish grid
+        lua_getfield(L, -1, "columns");
+        int columns = luaL_optinteger(L, -1, 0);
+        lua_pop(L, 1);
+
+        add_sprite_in_memory(name, data, width, height, ntiles, columns);
 
         lua_pop(L, 1);
     }
@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <lua.h>
+#include "luaalloc.h"
+#include "luaprof.h"
+
+/*
+Global vars
+*/
+LuaMemory lua_memory;
+
+#define LUA_POOL_MAX_SIZE (LUA_POOL_GRANULARITY * LUA_POOL_CLASSES)
+
+static int pool_class(size_t size) {
+    return (int) ((size - 1) / LUA_POOL_GRANULARITY);
+}
+
+/**
+Lua Allocator Functions
+**/
+//----------------------------------------------------------------------------------
+// Pages are never handed back: freed blocks stay on their class list, so the
+// heap doesn't fragment as scripts churn small tables, strings and closures
+//----------------------------------------------------------------------------------
+static bool pool_grow(LuaPoolClass *pool) {
+    char *page = (char *) malloc(LUA_POOL_PAGE_SIZE);
+    if (page == NULL) return false;
+
+    int blocks = LUA_POOL_PAGE_SIZE / pool->block_size;
+    for (int i = blocks - 1; i >= 0; i--) {
+        void **block = (void **) (page + i * pool->block_size);
+        *block = pool->free_list;
+        pool->free_list = block;
+    }
+
+    pool->pages++;
+    pool->free += blocks;
+    lua_memory.pool_bytes += LUA_POOL_PAGE_SIZE;
+
+    return true;
+}
+
+static void* pool_alloc(LuaPoolClass *pool) {
+    if (pool->free_list == NULL && !pool_grow(pool)) return NULL;
+
+    void **block = (void **) pool->free_list;
+    pool->free_list = *block;
+    pool->free--;
+    pool->used++;
+    pool->allocations++;
+
+    return block;
+}
+
+static void pool_free(LuaPoolClass *pool, void *ptr) {
+    *(void **) ptr = pool->free_list;
+    pool->free_list = ptr;
+    pool->free++;
+    pool->used--;
+}
+
+//----------------------------------------------------------------------------------
+// lua_Alloc: Lua always passes the block's real size as osize, so the class of
+// a block is known without a header
+//----------------------------------------------------------------------------------
+static void* lua_pool_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+    (void) ud;
+
+    // When ptr is NULL, osize holds the object type instead of a size
+    if (ptr == NULL) osize = 0;
+
+    bool old_small = osize > 0 && osize <= LUA_POOL_MAX_SIZE;
+    bool new_small = nsize > 0 && nsize <= LUA_POOL_MAX_SIZE;
+
+    if (nsize == 0) {
+        if (old_small) {
+            pool_free(&lua_memory.classes[pool_class(osize)], ptr);
+        } else if (ptr != NULL) {
+            free(ptr);
+            lua_memory.large_bytes -= osize;
+            lua_memory.large_blocks--;
+        }
+        return NULL;
+    }
+
+    if (alloc_profile.enabled && nsize > osize) record_lua_allocation(nsize - osize);
+
+    if (old_small && new_small && pool_class(osize) == pool_class(nsize)) return ptr;
+
+    if (!old_small && !new_small) {
+        void *block = realloc(ptr, nsize);
+        if (block == NULL) return NULL;
+
+        lua_memory.large_bytes += nsize - osize;
+        if (ptr == NULL) lua_memory.large_blocks++;
+        return block;
+    }
+
+    void *block;
+    if (new_small) {
+        block = pool_alloc(&lua_memory.classes[pool_class(nsize)]);
+
+        // A block shrinking into a class whose pool can't grow is adopted by
+        // that class when it is freed; a growing one can't stay in place
+        if (block == NULL) {
+            if (ptr == NULL || osize < nsize) return NULL;
+
+            if (old_small) {
+                lua_memory.classes[pool_class(osize)].used--;
+            } else {
+                lua_memory.large_bytes -= osize;
+                lua_memory.large_blocks--;
+            }
+            lua_memory.classes[pool_class(nsize)].used++;
+            return ptr;
+        }
+    } else {
+        block = malloc(nsize);
+        if (block == NULL) return NULL;
+
+        lua_memory.large_bytes += nsize;
+        lua_memory.large_blocks++;
+    }
+
+    if (ptr != NULL) {
+        memcpy(block, ptr, osize < nsize ? osize : nsize);
+        lua_pool_alloc(ud, ptr, osize, 0);
+    }
+
+    return block;
+}
+
+static int lua_panic(lua_State *L) {
+    const char *message = lua_tostring(L, -1);
+    printf("PANIC: unprotected error in call to Lua API (%s)\n", message ? message : "error object is not a string");
+    return 0;
+}
+
+//----------------------------------------------------------------------------------
+// Same as luaL_newstate(), on the pooled allocator
+//----------------------------------------------------------------------------------
+lua_State* new_lua_state() {
+    memset(&lua_memory, 0, sizeof(LuaMemory));
+    for (int i = 0; i < LUA_POOL_CLASSES; i++) {
+        lua_memory.classes[i].block_size = (i + 1) * LUA_POOL_GRANULARITY;
+    }
+
+    lua_State *L = lua_newstate(lua_pool_alloc, NULL);
+    if (L != NULL) lua_atpanic(L, lua_panic);
+
+    return L;
+}
+
+//----------------------------------------------------------------------------------
+// Bytes handed to Lua: used pool blocks plus large blocks
+//----------------------------------------------------------------------------------
+size_t lua_memory_in_use() {
+    size_t bytes = lua_memory.large_bytes;
+    for (int i = 0; i < LUA_POOL_CLASSES; i++) {
+        bytes += (size_t) lua_memory.classes[i].used * lua_memory.classes[i].block_size;
+    }
+    return bytes;
+}
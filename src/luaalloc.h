@@ -0,0 +1,14 @@
+#ifndef LUAALLOC_H
+#define LUAALLOC_H
+
+#include <lua.h>
+#include "types.h"
+
+/*
+Lua Allocator Functions
+*/
+extern LuaMemory lua_memory;
+lua_State* new_lua_state();
+size_t lua_memory_in_use();
+
+#endif
@@ -0,0 +1,82 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <lua.h>
+#include "raylib.h"
+#include "luagc.h"
+
+/*
+Constants
+*/
+// Left for swapping buffers and the browser at the end of the frame
+#define GC_FRAME_MARGIN (1.0 / 1000)
+// Time a requested collection gets even when the frame is already over budget
+#define GC_COLLECT_MIN_SECONDS (3.0 / 1000)
+// A new cycle starts once the heap grows this much (percent) past the last one
+#define GC_PAUSE 200
+
+/*
+Global vars
+*/
+LuaGc lua_gc_state;
+
+/**
+Lua GC Functions
+**/
+//----------------------------------------------------------------------------------
+// Incremental mode with the automatic collector stopped: from here on only
+// step_lua_gc() collects
+//----------------------------------------------------------------------------------
+void init_lua_gc(lua_State *L) {
+    lua_gc(L, LUA_GCINC, 0, 0, 0);
+    lua_gc(L, LUA_GCSTOP);
+
+    lua_gc_state.threshold_kb = lua_gc(L, LUA_GCCOUNT) * GC_PAUSE / 100;
+}
+
+//----------------------------------------------------------------------------------
+// A full collection spread over the next frames: the cycle in progress, if
+// any, can't free what became garbage during it, so one more follows
+//----------------------------------------------------------------------------------
+void request_lua_collect() {
+    lua_gc_state.pending_cycles = lua_gc_state.in_cycle ? 2 : 1;
+}
+
+//----------------------------------------------------------------------------------
+// Steps the collector until the frame's time is used up. Nothing runs between
+// cycles until the heap crosses the pause threshold; past it at least one step
+// runs per frame so memory can't grow unbounded on slow frames.
+//----------------------------------------------------------------------------------
+void step_lua_gc(lua_State *L, double frame_start, double frame_seconds) {
+    double start = GetTime();
+    int steps = 0;
+
+    if (!lua_gc_state.in_cycle && lua_gc_state.pending_cycles == 0
+        && lua_gc(L, LUA_GCCOUNT) < lua_gc_state.threshold_kb) {
+        lua_gc_state.steps = 0;
+        lua_gc_state.frame_ms = 0;
+        return;
+    }
+
+    double deadline = frame_start + frame_seconds - GC_FRAME_MARGIN;
+    if (lua_gc_state.pending_cycles > 0 && deadline < start + GC_COLLECT_MIN_SECONDS) {
+        deadline = start + GC_COLLECT_MIN_SECONDS;
+    }
+
+    do {
+        lua_gc_state.in_cycle = true;
+        steps++;
+
+        if (lua_gc(L, LUA_GCSTEP, 0)) {
+            lua_gc_state.in_cycle = false;
+            lua_gc_state.cycles++;
+            lua_gc_state.threshold_kb = lua_gc(L, LUA_GCCOUNT) * GC_PAUSE / 100;
+
+            if (lua_gc_state.pending_cycles > 0) lua_gc_state.pending_cycles--;
+            if (lua_gc_state.pending_cycles == 0) break;
+        }
+    } while (GetTime() < deadline);
+
+    lua_gc_state.steps = steps;
+    lua_gc_state.frame_ms = (GetTime() - start) * 1000;
+}
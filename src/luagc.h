@@ -0,0 +1,15 @@
+#ifndef LUAGC_H
+#define LUAGC_H
+
+#include <lua.h>
+#include "types.h"
+
+/*
+Lua GC Functions
+*/
+extern LuaGc lua_gc_state;
+void init_lua_gc(lua_State *L);
+void request_lua_collect();
+void step_lua_gc(lua_State *L, double frame_start, double frame_seconds);
+
+#endif
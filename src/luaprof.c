@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <lua.h>
+#include "luaprof.h"
+
+/*
+Constants
+*/
+#define ALLOC_SITES_INITIAL_CAPACITY 1024
+
+/*
+Global vars
+*/
+AllocProfile alloc_profile;
+
+static unsigned int site_hash(const char *key, int line) {
+    uintptr_t value = (uintptr_t) key ^ ((uintptr_t) line * 2654435761u);
+    return (unsigned int) (value ^ (value >> 15));
+}
+
+//----------------------------------------------------------------------------------
+// Open addressing on (source, line); the capacity is a power of two
+//----------------------------------------------------------------------------------
+static AllocSite* find_site(AllocSite *sites, int capacity, const char *key, int line) {
+    unsigned int index = site_hash(key, line) & (capacity - 1);
+
+    while (sites[index].key != NULL && (sites[index].key != key || sites[index].line != line)) {
+        index = (index + 1) & (capacity - 1);
+    }
+
+    return &sites[index];
+}
+
+static void grow_sites() {
+    int capacity = alloc_profile.capacity * 2;
+    AllocSite *sites = (AllocSite *) calloc(capacity, sizeof(AllocSite));
+
+    for (int i = 0; i < alloc_profile.capacity; i++) {
+        AllocSite *site = &alloc_profile.sites[i];
+        if (site->key != NULL) *find_site(sites, capacity, site->key, site->line) = *site;
+    }
+
+    free(alloc_profile.sites);
+    alloc_profile.sites = sites;
+    alloc_profile.capacity = capacity;
+}
+
+//----------------------------------------------------------------------------------
+// Tracks the line being run. Returns move it back to the caller's line, so
+// allocations after a call aren't charged to the callee's last line.
+//----------------------------------------------------------------------------------
+static void alloc_profile_hook(lua_State *L, lua_Debug *ar) {
+    lua_Debug caller;
+    lua_Debug *info = ar;
+
+    if (ar->event == LUA_HOOKRET) {
+        if (!lua_getstack(L, 1, &caller)) {
+            alloc_profile.current_key = NULL;
+            return;
+        }
+        info = &caller;
+    }
+
+    // "S" and "l" only fill in fields; nothing is allocated here
+    lua_getinfo(L, "Sl", info);
+    alloc_profile.current_key = info->source;
+    alloc_profile.current_line = info->currentline;
+    memcpy(alloc_profile.current_source, info->short_src, ALLOC_SITE_SOURCE_SIZE);
+}
+
+/**
+Lua Allocation Profiler Functions
+**/
+//----------------------------------------------------------------------------------
+// Starts a new profile; the line hook slows every script down while it runs
+//----------------------------------------------------------------------------------
+void start_alloc_profile(lua_State *L) {
+    free(alloc_profile.sites);
+    memset(&alloc_profile, 0, sizeof(AllocProfile));
+
+    alloc_profile.capacity = ALLOC_SITES_INITIAL_CAPACITY;
+    alloc_profile.sites = (AllocSite *) calloc(alloc_profile.capacity, sizeof(AllocSite));
+    alloc_profile.enabled = true;
+
+    lua_sethook(L, alloc_profile_hook, LUA_MASKLINE | LUA_MASKRET, 0);
+}
+
+//----------------------------------------------------------------------------------
+// Keeps the collected sites for reporting
+//----------------------------------------------------------------------------------
+void stop_alloc_profile(lua_State *L) {
+    alloc_profile.enabled = false;
+    alloc_profile.current_key = NULL;
+
+    lua_sethook(L, NULL, 0, 0);
+}
+
+//----------------------------------------------------------------------------------
+// Called by the Lua allocator for new blocks and growth; allocations made
+// outside Lua code (loading, C bindings called from C) aren't attributed
+//----------------------------------------------------------------------------------
+void record_lua_allocation(size_t bytes) {
+    if (alloc_profile.current_key == NULL) return;
+
+    if ((alloc_profile.count + 1) * 4 > alloc_profile.capacity * 3) grow_sites();
+
+    AllocSite *site = find_site(alloc_profile.sites, alloc_profile.capacity, alloc_profile.current_key, alloc_profile.current_line);
+    if (site->key == NULL) {
+        site->key = alloc_profile.current_key;
+        site->line = alloc_profile.current_line;
+        memcpy(site->source, alloc_profile.current_source, ALLOC_SITE_SOURCE_SIZE);
+        alloc_profile.count++;
+    }
+
+    site->frame_bytes += (int) bytes;
+    site->frame_count++;
+}
+
+void end_alloc_profile_frame() {
+    if (!alloc_profile.enabled) return;
+
+    for (int i = 0; i < alloc_profile.capacity; i++) {
+        AllocSite *site = &alloc_profile.sites[i];
+        if (site->key == NULL) continue;
+
+        site->last_bytes = site->frame_bytes;
+        site->last_count = site->frame_count;
+        site->total_bytes += site->frame_bytes;
+        site->total_count += site->frame_count;
+        site->frame_bytes = 0;
+        site->frame_count = 0;
+    }
+
+    alloc_profile.frames++;
+}
+
+static int compare_sites(const void *a, const void *b) {
+    double bytes_a = (*(const AllocSite **) a)->total_bytes;
+    double bytes_b = (*(const AllocSite **) b)->total_bytes;
+
+    return (bytes_a < bytes_b) - (bytes_a > bytes_b);
+}
+
+//----------------------------------------------------------------------------------
+// Sites by total bytes, largest first; the caller frees the array
+//----------------------------------------------------------------------------------
+AllocSite** sorted_alloc_sites(int *count) {
+    AllocSite **sorted = (AllocSite **) malloc(sizeof(AllocSite *) * (alloc_profile.count + 1));
+    *count = 0;
+
+    for (int i = 0; i < alloc_profile.capacity; i++) {
+        if (alloc_profile.sites[i].key != NULL) sorted[(*count)++] = &alloc_profile.sites[i];
+    }
+
+    qsort(sorted, *count, sizeof(AllocSite *), compare_sites);
+
+    return sorted;
+}
@@ -0,0 +1,17 @@
+#ifndef LUAPROF_H
+#define LUAPROF_H
+
+#include <lua.h>
+#include "types.h"
+
+/*
+Lua Allocation Profiler Functions
+*/
+extern AllocProfile alloc_profile;
+void start_alloc_profile(lua_State *L);
+void stop_alloc_profile(lua_State *L);
+void record_lua_allocation(size_t bytes);
+void end_alloc_profile_frame();
+AllocSite** sorted_alloc_sites(int *count);
+
+#endif
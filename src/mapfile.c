@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "drawlist.h"
+#include "tilemap.h"
+#include "mapfile.h"
+#include "assets.h"
+#include "registry.h"
+
+/*
+Global vars
+*/
+Registry map_files;
+int map_chunks_resident = 0;
+extern const int screenWidth;
+extern const int screenHeight;
+
+/*
+File layout (little-endian):
+    "LMAP", u16 version, u16 width, u16 height, u16 layers, u16 chunk_size, u16 reserved
+    chunks_x * chunks_y entries of u32 offset, u32 length (row-major)
+    per chunk, per layer: (u16 count, u16 value) runs covering chunk_size^2 cells, row-major
+*/
+#define MAP_FILE_VERSION 1
+#define MAP_FILE_HEADER_SIZE 16
+
+static int read_u16(const unsigned char *bytes) {
+    return bytes[0] | (bytes[1] << 8);
+}
+
+static uint32_t read_u32(const unsigned char *bytes) {
+    return (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8) | ((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+/**
+Map File Functions
+**/
+//----------------------------------------------------------------------------------
+// Reads the header and chunk table only; returns 0 when the file is missing,
+// not a map file, or has no layers or chunk size
+//----------------------------------------------------------------------------------
+int open_map_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return 0;
+
+    unsigned char header[MAP_FILE_HEADER_SIZE];
+    if (fread(header, 1, MAP_FILE_HEADER_SIZE, file) != MAP_FILE_HEADER_SIZE
+        || memcmp(header, "LMAP", 4) != 0 || read_u16(header + 4) != MAP_FILE_VERSION
+        || read_u16(header + 10) == 0 || read_u16(header + 12) == 0) {
+        fclose(file);
+        return 0;
+    }
+
+    MapFile *map = (MapFile *) malloc(sizeof(MapFile));
+    map->file = file;
+    map->width = read_u16(header + 6);
+    map->height = read_u16(header + 8);
+    map->layers = read_u16(header + 10);
+    map->chunk_size = read_u16(header + 12);
+    map->chunks_x = (map->width + map->chunk_size - 1) / map->chunk_size;
+    map->chunks_y = (map->height + map->chunk_size - 1) / map->chunk_size;
+    map->group = current_asset_group;
+
+    int chunk_count = map->chunks_x * map->chunks_y;
+    map->chunk_offsets = (uint32_t *) malloc(sizeof(uint32_t) * chunk_count);
+    map->chunk_lengths = (uint32_t *) malloc(sizeof(uint32_t) * chunk_count);
+    map->chunks = (uint16_t **) calloc(chunk_count, sizeof(uint16_t *));
+    map->chunk_frames = (int *) calloc(chunk_count, sizeof(int));
+
+    for (int i = 0; i < chunk_count; i++) {
+        unsigned char entry[8];
+        if (fread(entry, 1, 8, file) != 8) {
+            map->chunk_offsets[i] = 0;
+            map->chunk_lengths[i] = 0;
+            continue;
+        }
+        map->chunk_offsets[i] = read_u32(entry);
+        map->chunk_lengths[i] = read_u32(entry + 4);
+    }
+
+    return registry_add(&map_files, map);
+}
+
+MapFile* get_map_file(int id) {
+    return (MapFile *) registry_get(&map_files, id);
+}
+
+void close_map_file(int id) {
+    MapFile *map = get_map_file(id);
+    if (map == NULL) return;
+
+    for (int i = 0; i < map->chunks_x * map->chunks_y; i++) {
+        if (map->chunks[i] != NULL) {
+            free(map->chunks[i]);
+            map_chunks_resident--;
+        }
+    }
+
+    fclose(map->file);
+    free(map->chunks);
+    free(map->chunk_frames);
+    free(map->chunk_offsets);
+    free(map->chunk_lengths);
+    free(map);
+
+    registry_remove(&map_files, id);
+}
+
+//----------------------------------------------------------------------------------
+// Expands the runs of one chunk into cells (layers * chunk_size^2 values).
+// A short or corrupt chunk leaves the remaining cells empty.
+//----------------------------------------------------------------------------------
+static void map_file_decode_chunk(MapFile *map, int index, uint16_t *cells) {
+    int cell_count = map->layers * map->chunk_size * map->chunk_size;
+    memset(cells, 0, sizeof(uint16_t) * cell_count);
+
+    uint32_t length = map->chunk_lengths[index];
+    if (length == 0 || fseek(map->file, map->chunk_offsets[index], SEEK_SET) != 0) return;
+
+    unsigned char *runs = (unsigned char *) malloc(length);
+    length = fread(runs, 1, length, map->file);
+
+    int filled = 0;
+    for (uint32_t i = 0; i + 4 <= length && filled < cell_count; i += 4) {
+        int count = read_u16(runs + i);
+        uint16_t value = read_u16(runs + i + 2);
+
+        if (count > cell_count - filled) count = cell_count - filled;
+        for (int k = 0; k < count; k++) {
+            cells[filled++] = value;
+        }
+    }
+
+    free(runs);
+}
+
+static uint16_t* map_file_chunk(MapFile *map, int cx, int cy) {
+    int index = cy * map->chunks_x + cx;
+
+    if (map->chunks[index] == NULL) {
+        map->chunks[index] = (uint16_t *) malloc(sizeof(uint16_t) * map->layers * map->chunk_size * map->chunk_size);
+        map_file_decode_chunk(map, index, map->chunks[index]);
+        map_chunks_resident++;
+    }
+
+    map->chunk_frames[index] = current_frame;
+    return map->chunks[index];
+}
+
+//----------------------------------------------------------------------------------
+// layer, x and y are 0-based; cells outside the map are 0. Reading a chunk that
+// isn't resident decodes it; map_file_stream() keeps it while it was read this
+// frame or the previous one and drops it once out of view and unread.
+//----------------------------------------------------------------------------------
+uint16_t map_file_get(MapFile *map, int layer, int x, int y) {
+    if (layer < 0 || layer >= map->layers || x < 0 || y < 0 || x >= map->width || y >= map->height) return 0;
+
+    uint16_t *cells = map_file_chunk(map, x / map->chunk_size, y / map->chunk_size);
+    int local = (y % map->chunk_size) * map->chunk_size + x % map->chunk_size;
+
+    return cells[layer * map->chunk_size * map->chunk_size + local];
+}
+
+//----------------------------------------------------------------------------------
+// Keeps the chunks under the screen at (camx, camy), plus one chunk around it,
+// decoded and frees the rest. Chunks read this frame or the previous one stay
+// too, so off-screen readers like bodies don't decode them again every frame.
+//----------------------------------------------------------------------------------
+void map_file_stream(MapFile *map, int camx, int camy, int tile_size) {
+    int chunk_pixels = map->chunk_size * tile_size;
+    if (chunk_pixels <= 0) return;
+
+    int first_cx = (int) floorf((float) camx / chunk_pixels) - 1;
+    int first_cy = (int) floorf((float) camy / chunk_pixels) - 1;
+    int last_cx = (int) floorf((float) (camx + screenWidth) / chunk_pixels) + 1;
+    int last_cy = (int) floorf((float) (camy + screenHeight) / chunk_pixels) + 1;
+
+    for (int cy = 0; cy < map->chunks_y; cy++) {
+        for (int cx = 0; cx < map->chunks_x; cx++) {
+            bool near = cx >= first_cx && cx <= last_cx && cy >= first_cy && cy <= last_cy;
+            int index = cy * map->chunks_x + cx;
+
+            if (near) {
+                map_file_chunk(map, cx, cy);
+            } else if (map->chunks[index] != NULL && current_frame - map->chunk_frames[index] > 1) {
+                free(map->chunks[index]);
+                map->chunks[index] = NULL;
+                map_chunks_resident--;
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------
+// Cells of a chunk without making it resident: decoded into scratch
+// (layers * chunk_size^2 values) unless it already is
+//----------------------------------------------------------------------------------
+const uint16_t* map_file_peek_chunk(MapFile *map, int cx, int cy, uint16_t *scratch) {
+    int index = cy * map->chunks_x + cx;
+    if (map->chunks[index] != NULL) return map->chunks[index];
+
+    map_file_decode_chunk(map, index, scratch);
+    return scratch;
+}
+
+//----------------------------------------------------------------------------------
+// Copies one layer (0-based) into a new tile map, chunk by chunk
+//----------------------------------------------------------------------------------
+int map_file_to_tilemap(MapFile *map, int layer, int tile_size) {
+    int id = create_tilemap(map->width, map->height, tile_size);
+    TileMap *tilemap = get_tilemap(id);
+
+    if (layer < 0 || layer >= map->layers) return id;
+
+    int chunk_cells = map->chunk_size * map->chunk_size;
+    uint16_t *scratch = (uint16_t *) malloc(sizeof(uint16_t) * map->layers * chunk_cells);
+
+    for (int cy = 0; cy < map->chunks_y; cy++) {
+        for (int cx = 0; cx < map->chunks_x; cx++) {
+            const uint16_t *cells = map_file_peek_chunk(map, cx, cy, scratch);
+
+            for (int i = 0; i < chunk_cells; i++) {
+                uint16_t value = cells[layer * chunk_cells + i];
+                if (value == 0) continue;
+
+                tilemap_set(tilemap, cx * map->chunk_size + i % map->chunk_size, cy * map->chunk_size + i / map->chunk_size, value);
+            }
+        }
+    }
+
+    free(scratch);
+
+    return id;
+}
@@ -0,0 +1,19 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include "types.h"
+
+/*
+Map File Functions
+*/
+extern Registry map_files;
+extern int map_chunks_resident;
+int open_map_file(const char *path);
+MapFile* get_map_file(int id);
+void close_map_file(int id);
+uint16_t map_file_get(MapFile *map, int layer, int x, int y);
+void map_file_stream(MapFile *map, int camx, int camy, int tile_size);
+const uint16_t* map_file_peek_chunk(MapFile *map, int cx, int cy, uint16_t *scratch);
+int map_file_to_tilemap(MapFile *map, int layer, int tile_size);
+
+#endif
@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "drawlist.h"
+#include "particles.h"
+#include "assets.h"
+#include "registry.h"
+
+/*
+Global vars
+*/
+Registry particle_emitters;
+
+static float random_spread(float spread) {
+    return spread * (float) (rand() / (RAND_MAX + 1.0));
+}
+
+/**
+Particle Emitter Functions
+**/
+int create_emitter(EmitterSettings settings, int max_particles) {
+    ParticleEmitter *emitter = (ParticleEmitter *) calloc(1, sizeof(ParticleEmitter));
+    emitter->settings = settings;
+    emitter->max_count = max_particles > 0 ? max_particles : 1;
+    emitter->group = current_asset_group;
+
+    emitter->x = (float *) malloc(sizeof(float) * emitter->max_count);
+    emitter->y = (float *) malloc(sizeof(float) * emitter->max_count);
+    emitter->vx = (float *) malloc(sizeof(float) * emitter->max_count);
+    emitter->vy = (float *) malloc(sizeof(float) * emitter->max_count);
+    emitter->size = (float *) malloc(sizeof(float) * emitter->max_count);
+    emitter->age = (int *) malloc(sizeof(int) * emitter->max_count);
+
+    return registry_add(&particle_emitters, emitter);
+}
+
+ParticleEmitter* get_emitter(int id) {
+    return (ParticleEmitter *) registry_get(&particle_emitters, id);
+}
+
+void delete_emitter(int id) {
+    ParticleEmitter *emitter = get_emitter(id);
+    if (emitter == NULL) return;
+
+    free(emitter->x);
+    free(emitter->y);
+    free(emitter->vx);
+    free(emitter->vy);
+    free(emitter->size);
+    free(emitter->age);
+    free(emitter);
+    registry_remove(&particle_emitters, id);
+}
+
+//----------------------------------------------------------------------------------
+// Places the emitter for the next step; it only spawns in steps it was placed for
+//----------------------------------------------------------------------------------
+void emitter_at(ParticleEmitter *emitter, float x, float y) {
+    emitter->spawn_x = x;
+    emitter->spawn_y = y;
+    emitter->armed = true;
+}
+
+static void emitter_spawn(ParticleEmitter *emitter) {
+    EmitterSettings *settings = &emitter->settings;
+
+    emitter->spawn_budget += settings->rate;
+
+    while (emitter->spawn_budget >= 1.0f && emitter->count < emitter->max_count) {
+        int i = emitter->count++;
+
+        emitter->x[i] = emitter->spawn_x + random_spread(settings->spread_x);
+        emitter->y[i] = emitter->spawn_y + random_spread(settings->spread_y);
+        emitter->vx[i] = settings->vx;
+        emitter->vy[i] = settings->vy;
+        emitter->size[i] = settings->size;
+        emitter->age[i] = 0;
+
+        emitter->spawn_budget -= 1.0f;
+    }
+
+    // A full emitter doesn't bank spawns for later
+    if (emitter->spawn_budget > 1.0f) emitter->spawn_budget = 1.0f;
+}
+
+//----------------------------------------------------------------------------------
+// Spawns, draws every particle into the frame's color batches (as ui.circfill
+// would), then advances them one frame and drops the ones that died
+//----------------------------------------------------------------------------------
+void emitter_step(ParticleEmitter *emitter, int camx, int camy) {
+    EmitterSettings *settings = &emitter->settings;
+
+    if (emitter->armed) emitter_spawn(emitter);
+    emitter->armed = false;
+
+    int count = emitter->count;
+    float *x = emitter->x, *y = emitter->y, *vx = emitter->vx, *vy = emitter->vy, *size = emitter->size;
+    int *age = emitter->age;
+
+    // Without colors the particles still move but aren't drawn
+    for (int i = 0; i < count && settings->ramp_count > 0; i++) {
+        int step = settings->lifetime > 0 ? age[i] * settings->ramp_count / settings->lifetime : 0;
+        if (step >= settings->ramp_count) step = settings->ramp_count - 1;
+
+        batch_add_circle((int) floorf(x[i] - camx), (int) floorf(y[i] - camy), floorf(size[i] + 0.5f) + 0.5f, get_palette_color(settings->ramp[step]));
+    }
+
+    for (int i = 0; i < count; i++) {
+        x[i] += vx[i];
+        y[i] += vy[i];
+        vy[i] += settings->gravity;
+        size[i] -= settings->shrink;
+        age[i]++;
+    }
+
+    // Swap-remove keeps the arrays packed
+    for (int i = 0; i < count; ) {
+        bool dead = size[i] <= 0 || (settings->lifetime > 0 && age[i] >= settings->lifetime);
+        if (!dead) {
+            i++;
+            continue;
+        }
+
+        count--;
+        x[i] = x[count];
+        y[i] = y[count];
+        vx[i] = vx[count];
+        vy[i] = vy[count];
+        size[i] = size[count];
+        age[i] = age[count];
+    }
+
+    emitter->count = count;
+}
@@ -0,0 +1,16 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include "types.h"
+
+/*
+Particle Emitter Functions
+*/
+extern Registry particle_emitters;
+int create_emitter(EmitterSettings settings, int max_particles);
+ParticleEmitter* get_emitter(int id);
+void delete_emitter(int id);
+void emitter_at(ParticleEmitter *emitter, float x, float y);
+void emitter_step(ParticleEmitter *emitter, int camx, int camy);
+
+#endif
@@ -0,0 +1,33 @@
+#include <stdlib.h>
+
+#include "registry.h"
+
+/**
+Id Registry Functions
+**/
+//----------------------------------------------------------------------------------
+// Stores the item in a new slot and returns its id. Slots are never reused: the
+// id of a removed item stays invalid instead of silently naming the next one
+//----------------------------------------------------------------------------------
+int registry_add(Registry *registry, void *item) {
+    if (registry->count == registry->max_count) {
+        registry->max_count = registry->max_count == 0 ? 8 : registry->max_count * 2;
+        registry->items = (void **) realloc(registry->items, sizeof(void *) * registry->max_count);
+    }
+
+    registry->items[registry->count++] = item;
+
+    return registry->count;
+}
+
+// NULL for ids never handed out and for removed items
+void* registry_get(Registry *registry, int id) {
+    if (id < 1 || id > registry->count) return NULL;
+    return registry->items[id - 1];
+}
+
+// Only empties the slot; freeing the item is up to the caller
+void registry_remove(Registry *registry, int id) {
+    if (id < 1 || id > registry->count) return;
+    registry->items[id - 1] = NULL;
+}
@@ -0,0 +1,13 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "types.h"
+
+/*
+Id Registry Functions
+*/
+int registry_add(Registry *registry, void *item);
+void* registry_get(Registry *registry, int id);
+void registry_remove(Registry *registry, int id);
+
+#endif
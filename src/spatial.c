@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "drawlist.h"
+#include "spatial.h"
+#include "assets.h"
+#include "registry.h"
+
+/*
+Global vars
+*/
+Registry spatial_hashes;
+
+static int cell_bucket(int cx, int cy) {
+    unsigned int hash = (unsigned int) cx * 73856093u ^ (unsigned int) cy * 19349663u;
+    return (int) (hash & (SPATIAL_BUCKETS - 1));
+}
+
+static int cell_of(SpatialHash *hash, float value) {
+    return (int) floorf(value / hash->cell_size);
+}
+
+static void bucket_add(SpatialBucket *bucket, int entity) {
+    if (bucket->count == bucket->max_count) {
+        bucket->max_count = bucket->max_count == 0 ? 4 : bucket->max_count * 2;
+        bucket->ids = (int *) realloc(bucket->ids, sizeof(int) * bucket->max_count);
+    }
+    bucket->ids[bucket->count++] = entity;
+}
+
+static void bucket_remove(SpatialBucket *bucket, int entity) {
+    for (int i = 0; i < bucket->count; i++) {
+        if (bucket->ids[i] == entity) {
+            bucket->ids[i] = bucket->ids[--bucket->count];
+            return;
+        }
+    }
+}
+
+// Adds or removes the entity in every cell of its current range
+static void spatial_hash_link(SpatialHash *hash, int entity, bool add) {
+    SpatialEntity *e = &hash->entities[entity];
+
+    for (int cy = e->cy0; cy <= e->cy1; cy++) {
+        for (int cx = e->cx0; cx <= e->cx1; cx++) {
+            SpatialBucket *bucket = &hash->buckets[cell_bucket(cx, cy)];
+            if (add) {
+                bucket_add(bucket, entity);
+            } else {
+                bucket_remove(bucket, entity);
+            }
+        }
+    }
+}
+
+static void query_bucket(SpatialHash *hash, SpatialBucket *bucket, Rectangle box, int **results, int *max_results, int *count) {
+    for (int i = 0; i < bucket->count; i++) {
+        SpatialEntity *e = &hash->entities[bucket->ids[i]];
+        if (e->stamp == hash->stamp) continue;
+
+        e->stamp = hash->stamp;
+        if (!CheckCollisionRecs(e->box, box)) continue;
+
+        if (*count == *max_results) {
+            *max_results = *max_results == 0 ? 16 : *max_results * 2;
+            *results = (int *) realloc(*results, sizeof(int) * *max_results);
+        }
+        (*results)[(*count)++] = bucket->ids[i];
+    }
+}
+
+static int compare_ids(const void *a, const void *b) {
+    return *(const int *) a - *(const int *) b;
+}
+
+/**
+Spatial Hash Functions
+**/
+int create_spatial_hash(int cell_size) {
+    SpatialHash *hash = (SpatialHash *) calloc(1, sizeof(SpatialHash));
+    hash->cell_size = cell_size > 0 ? cell_size : 16;
+    hash->group = current_asset_group;
+
+    return registry_add(&spatial_hashes, hash);
+}
+
+SpatialHash* get_spatial_hash(int id) {
+    return (SpatialHash *) registry_get(&spatial_hashes, id);
+}
+
+void delete_spatial_hash(int id) {
+    SpatialHash *hash = get_spatial_hash(id);
+    if (hash == NULL) return;
+
+    for (int i = 0; i < SPATIAL_BUCKETS; i++) {
+        free(hash->buckets[i].ids);
+    }
+
+    free(hash->entities);
+    free(hash);
+    registry_remove(&spatial_hashes, id);
+}
+
+//----------------------------------------------------------------------------------
+// Inserts or moves an entity (id >= 1). Buckets are only touched when the box
+// crosses into other cells.
+//----------------------------------------------------------------------------------
+void spatial_hash_set(SpatialHash *hash, int entity, Rectangle box) {
+    if (entity < 1) return;
+
+    if (entity >= hash->entity_count) {
+        int count = hash->entity_count == 0 ? 64 : hash->entity_count;
+        while (count <= entity) count *= 2;
+
+        hash->entities = (SpatialEntity *) realloc(hash->entities, sizeof(SpatialEntity) * count);
+        memset(hash->entities + hash->entity_count, 0, sizeof(SpatialEntity) * (count - hash->entity_count));
+        hash->entity_count = count;
+    }
+
+    SpatialEntity *e = &hash->entities[entity];
+    int cx0 = cell_of(hash, box.x);
+    int cy0 = cell_of(hash, box.y);
+    int cx1 = cell_of(hash, box.x + box.width);
+    int cy1 = cell_of(hash, box.y + box.height);
+
+    e->box = box;
+    if (e->active && cx0 == e->cx0 && cy0 == e->cy0 && cx1 == e->cx1 && cy1 == e->cy1) return;
+
+    if (e->active) spatial_hash_link(hash, entity, false);
+
+    e->cx0 = cx0;
+    e->cy0 = cy0;
+    e->cx1 = cx1;
+    e->cy1 = cy1;
+    e->active = true;
+    spatial_hash_link(hash, entity, true);
+}
+
+void spatial_hash_remove(SpatialHash *hash, int entity) {
+    if (entity < 1 || entity >= hash->entity_count || !hash->entities[entity].active) return;
+
+    spatial_hash_link(hash, entity, false);
+    hash->entities[entity].active = false;
+}
+
+//----------------------------------------------------------------------------------
+// Ids of the entities overlapping box, ascending, into a growable array owned
+// by the caller; the cost follows the cells box covers, not the entity count
+//----------------------------------------------------------------------------------
+int spatial_hash_query(SpatialHash *hash, Rectangle box, int **results, int *max_results) {
+    int count = 0;
+    int cx0 = cell_of(hash, box.x);
+    int cy0 = cell_of(hash, box.y);
+    int cx1 = cell_of(hash, box.x + box.width);
+    int cy1 = cell_of(hash, box.y + box.height);
+
+    // Stamps skip entities already seen through another cell or shared bucket
+    hash->stamp++;
+
+    if ((double) (cx1 - cx0 + 1) * (cy1 - cy0 + 1) > SPATIAL_BUCKETS) {
+        // Covers more cells than there are buckets: visit each bucket once
+        for (int i = 0; i < SPATIAL_BUCKETS; i++) {
+            query_bucket(hash, &hash->buckets[i], box, results, max_results, &count);
+        }
+    } else {
+        for (int cy = cy0; cy <= cy1; cy++) {
+            for (int cx = cx0; cx <= cx1; cx++) {
+                query_bucket(hash, &hash->buckets[cell_bucket(cx, cy)], box, results, max_results, &count);
+            }
+        }
+    }
+
+    qsort(*results, count, sizeof(int), compare_ids);
+
+    return count;
+}
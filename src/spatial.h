@@ -0,0 +1,17 @@
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include "types.h"
+
+/*
+Spatial Hash Functions
+*/
+extern Registry spatial_hashes;
+int create_spatial_hash(int cell_size);
+SpatialHash* get_spatial_hash(int id);
+void delete_spatial_hash(int id);
+void spatial_hash_set(SpatialHash *hash, int entity, Rectangle box);
+void spatial_hash_remove(SpatialHash *hash, int entity);
+int spatial_hash_query(SpatialHash *hash, Rectangle box, int **results, int *max_results);
+
+#endif
@@ -0,0 +1,259 @@
+// Palette expansion micro-benchmark: checks each kernel against the scalar
+// loop, then times them over rows of index data. `make bench` builds it with
+// and without AVX2 and SSSE3. The game's own sheets are read from sprites.lua;
+// random rows with 16 to 256 colors bracket them.
+//
+// One run of the -mavx2 build on an x86-64 cloud VM (gcc 12, -O2), ns per
+// pixel; scalar numbers move by about 20% between runs:
+//                        scalar   avx2 gather   ssse3 shuffle
+//   game sheets, 16 px    0.72       0.32           0.65
+//   game sheets, 32 px    0.60       0.31           0.60
+//   game sheets, 61 px    0.47       0.36           0.54
+//   16 colors, 32 px      0.51       0.27           0.34
+//   256 colors, 32 px     0.53       0.26           2.92
+// The shuffle kernel only pays off when a block uses few 16-color slices, and
+// the game's sheets use about three, so only the gather made it into expand.c.
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "expand.h"
+
+#if defined(__SSSE3__)
+    #include <tmmintrin.h>
+#endif
+
+#define LUT_SIZE 256
+#define SYNTHETIC_PIXELS (64 * 1024)
+#define PIXELS_PER_RUN (64 * 1024 * 1024)
+#define RUNS 9
+
+typedef void (*ExpandKernel)(const uint8_t *, uint32_t *, int, const uint32_t *);
+
+typedef struct {
+    const char *name;
+    ExpandKernel kernel;
+    double best;
+} Candidate;
+
+#if defined(__SSSE3__)
+// The table split into one byte plane per channel
+static uint8_t planes[4][LUT_SIZE];
+
+//----------------------------------------------------------------------------------
+// Sixteen indices at a time: each 16-entry slice of a channel plane is one
+// pshufb. Indices outside the slice are pushed to 0x80 and above, which pshufb
+// turns into 0, so OR-ing the slices gives the channel. Only slices up to the
+// block's largest index are visited.
+//----------------------------------------------------------------------------------
+static void expand_indices_shuffle(const uint8_t *indices, uint32_t *out, int count, const uint32_t *lut) {
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i index = _mm_loadu_si128((const __m128i *) (indices + i));
+
+        __m128i top = _mm_max_epu8(index, _mm_srli_si128(index, 8));
+        top = _mm_max_epu8(top, _mm_srli_si128(top, 4));
+        top = _mm_max_epu8(top, _mm_srli_si128(top, 2));
+        top = _mm_max_epu8(top, _mm_srli_si128(top, 1));
+        int slices = ((_mm_cvtsi128_si32(top) & 0xFF) >> 4) + 1;
+
+        __m128i r = _mm_setzero_si128(), g = r, b = r, a = r;
+
+        for (int slice = 0; slice < slices; slice++) {
+            __m128i local = _mm_sub_epi8(index, _mm_set1_epi8((char) (slice * 16)));
+            local = _mm_adds_epu8(local, _mm_set1_epi8(0x70));
+
+            int base = slice * 16;
+            r = _mm_or_si128(r, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (planes[0] + base)), local));
+            g = _mm_or_si128(g, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (planes[1] + base)), local));
+            b = _mm_or_si128(b, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (planes[2] + base)), local));
+            a = _mm_or_si128(a, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (planes[3] + base)), local));
+        }
+
+        __m128i rg_low = _mm_unpacklo_epi8(r, g), rg_high = _mm_unpackhi_epi8(r, g);
+        __m128i ba_low = _mm_unpacklo_epi8(b, a), ba_high = _mm_unpackhi_epi8(b, a);
+
+        _mm_storeu_si128((__m128i *) (out + i), _mm_unpacklo_epi16(rg_low, ba_low));
+        _mm_storeu_si128((__m128i *) (out + i + 4), _mm_unpackhi_epi16(rg_low, ba_low));
+        _mm_storeu_si128((__m128i *) (out + i + 8), _mm_unpacklo_epi16(rg_high, ba_high));
+        _mm_storeu_si128((__m128i *) (out + i + 12), _mm_unpackhi_epi16(rg_high, ba_high));
+    }
+
+    expand_indices_scalar(indices + i, out + i, count - i, lut);
+}
+#endif
+
+static Candidate candidates[] = {
+    { "scalar", expand_indices_scalar, 0 },
+    { NULL, expand_indices, 0 },
+#if defined(__SSSE3__)
+    { "ssse3 shuffle", expand_indices_shuffle, 0 },
+#endif
+};
+
+#define CANDIDATES ((int) (sizeof(candidates) / sizeof(candidates[0])))
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Concatenated "data" strings of a SpriteSheets dump, with Lua escapes decoded
+static uint8_t* load_sheet_data(const char *path, int *size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *text = (char *) malloc(length + 1);
+    length = (long) fread(text, 1, length, file);
+    text[length] = '\0';
+    fclose(file);
+
+    uint8_t *data = (uint8_t *) malloc(length);
+    int count = 0;
+    const char *key = "[\"data\"] = \"";
+
+    for (char *p = strstr(text, key); p != NULL; p = strstr(p, key)) {
+        for (p += strlen(key); *p != '"' && *p != '\0'; p++) {
+            if (*p != '\\') {
+                data[count++] = (uint8_t) *p;
+            } else if (p[1] >= '0' && p[1] <= '9') {
+                int value = 0, digits = 0;
+                while (digits < 3 && p[1] >= '0' && p[1] <= '9') {
+                    value = value * 10 + (*++p - '0');
+                    digits++;
+                }
+                data[count++] = (uint8_t) value;
+            } else {
+                p++;
+                data[count++] = *p == 'n' ? '\n' : *p == 'r' ? '\r' : *p == 't' ? '\t' : (uint8_t) *p;
+            }
+        }
+    }
+
+    free(text);
+    *size = count;
+    return data;
+}
+
+static bool same_as_scalar(ExpandKernel kernel, const uint8_t *indices, int size, int width, const uint32_t *lut) {
+    uint32_t *expected = (uint32_t *) malloc(sizeof(uint32_t) * width);
+    uint32_t *actual = (uint32_t *) malloc(sizeof(uint32_t) * width);
+    bool same = true;
+
+    for (int x = 0; same && x + width <= size; x += width) {
+        expand_indices_scalar(indices + x, expected, width, lut);
+        kernel(indices + x, actual, width, lut);
+        same = memcmp(expected, actual, sizeof(uint32_t) * width) == 0;
+    }
+
+    free(expected);
+    free(actual);
+    return same;
+}
+
+// Nanoseconds per pixel, expanding `width` pixels per call the way sheet
+// decoding does for each tile row
+static double time_run(ExpandKernel kernel, const uint8_t *indices, uint32_t *out, int size, int width, const uint32_t *lut) {
+    int rows = size / width;
+    long pixels = 0;
+    double start = now_seconds();
+
+    while (pixels < PIXELS_PER_RUN) {
+        for (int row = 0; row < rows; row++) {
+            kernel(indices + row * width, out + row * width, width, lut);
+        }
+        pixels += (long) rows * width;
+    }
+
+    return (now_seconds() - start) * 1e9 / pixels;
+}
+
+static bool bench(const char *name, const uint8_t *indices, int size, const uint32_t *lut) {
+    uint32_t *out = (uint32_t *) malloc(sizeof(uint32_t) * size);
+    int widths[] = { 16, 32, 61 };
+
+    for (int w = 0; w < (int) (sizeof(widths) / sizeof(widths[0])); w++) {
+        int width = widths[w];
+
+        for (int c = 0; c < CANDIDATES; c++) {
+            if (!same_as_scalar(candidates[c].kernel, indices, size, width, lut)) {
+                printf("FAIL: %s differs from the scalar loop on %s, rows of %d\n", candidates[c].name, name, width);
+                free(out);
+                return false;
+            }
+        }
+
+        // Warms the caches and touches the output
+        time_run(expand_indices_scalar, indices, out, size, width, lut);
+
+        // Best of RUNS, alternating so every kernel sees the same machine state
+        for (int run = 0; run < RUNS; run++) {
+            for (int c = 0; c < CANDIDATES; c++) {
+                double ns = time_run(candidates[c].kernel, indices, out, size, width, lut);
+                if (run == 0 || ns < candidates[c].best) candidates[c].best = ns;
+            }
+        }
+
+        printf("  %-18s rows of %2d:", name, width);
+        for (int c = 0; c < CANDIDATES; c++) {
+            printf("  %s %.3f", candidates[c].name, candidates[c].best);
+        }
+        printf("\n");
+    }
+
+    free(out);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    static uint32_t lut[LUT_SIZE];
+    static uint8_t indices[SYNTHETIC_PIXELS];
+    const char *sprites = argc > 1 ? argv[1] : "../game-example/sprites.lua";
+
+    srand(1);
+    for (int i = 0; i < LUT_SIZE; i++) {
+        lut[i] = ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+#if defined(__SSSE3__)
+        for (int channel = 0; channel < 4; channel++) {
+            planes[channel][i] = (uint8_t) (lut[i] >> (channel * 8));
+        }
+#endif
+    }
+
+    // expand_indices() is one of the others when it isn't the gather
+    static char kernel_name[32];
+    snprintf(kernel_name, sizeof(kernel_name), "expand_indices (%s)", expand_kernel_name());
+    candidates[1].name = kernel_name;
+
+    printf("ns per pixel, best of %d\n", RUNS);
+
+    int size = 0;
+    uint8_t *sheets = load_sheet_data(sprites, &size);
+    if (sheets == NULL || size == 0) {
+        printf("FAIL: no sheet data in %s\n", sprites);
+        return 1;
+    }
+    if (!bench("game sheets", sheets, size, lut)) return 1;
+    free(sheets);
+
+    int colors[] = { 16, 64, 256 };
+    for (int c = 0; c < (int) (sizeof(colors) / sizeof(colors[0])); c++) {
+        char name[32];
+        snprintf(name, sizeof(name), "random, %d colors", colors[c]);
+
+        for (int i = 0; i < SYNTHETIC_PIXELS; i++) {
+            indices[i] = (uint8_t) (rand() % colors[c]);
+        }
+        if (!bench(name, indices, SYNTHETIC_PIXELS, lut)) return 1;
+    }
+
+    return 0;
+}
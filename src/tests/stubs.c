@@ -0,0 +1,51 @@
+// raylib and rlgl entry points the engine calls, stubbed out so engine code
+// can be linked into native tests without a window or GPU.
+#include <stdlib.h>
+#include "raylib.h"
+
+void ClearBackground(Color color) {}
+void DrawCircle(int x, int y, float r, Color c) {}
+void DrawCircleLines(int x, int y, float r, Color c) {}
+void DrawLine(int x1, int y1, int x2, int y2, Color c) {}
+void DrawPixel(int x, int y, Color c) {}
+void DrawRectangle(int x, int y, int w, int h, Color c) {}
+void DrawRectangleLines(int x, int y, int w, int h, Color c) {}
+void DrawText(const char *t, int x, int y, int s, Color c) {}
+void DrawTextureRec(Texture2D t, Rectangle r, Vector2 p, Color c) {}
+void DrawTriangle(Vector2 a, Vector2 b, Vector2 c, Color color) {}
+bool CheckCollisionRecs(Rectangle a, Rectangle b) {
+    return a.x < b.x + b.width && a.x + a.width > b.x && a.y < b.y + b.height && a.y + a.height > b.y;
+}
+void BeginTextureMode(RenderTexture2D t) {}
+void EndTextureMode(void) {}
+RenderTexture2D LoadRenderTexture(int w, int h) {
+    static unsigned int next_id = 1;
+    RenderTexture2D t = { 0 };
+    t.id = next_id++;
+    t.texture.id = t.id;
+    t.texture.width = w;
+    t.texture.height = h;
+    return t;
+}
+void UnloadRenderTexture(RenderTexture2D t) {}
+Image GenImageColor(int w, int h, Color c) {
+    Image image = { calloc((size_t) w * h, 4), w, h, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+    return image;
+}
+void UnloadImage(Image image) { free(image.data); }
+Texture2D LoadTextureFromImage(Image image) {
+    static unsigned int next_id = 1;
+    Texture2D t = { next_id++, image.width, image.height, 1, image.format };
+    return t;
+}
+void UnloadTexture(Texture2D t) {}
+void rlBegin(int mode) {}
+void rlEnd(void) {}
+void rlColor4ub(unsigned char r, unsigned char g, unsigned char b, unsigned char a) {}
+void rlNormal3f(float x, float y, float z) {}
+void rlPushMatrix(void) {}
+void rlPopMatrix(void) {}
+void rlSetTexture(unsigned int id) {}
+void rlTexCoord2f(float x, float y) {}
+void rlTranslatef(float x, float y, float z) {}
+void rlVertex2f(float x, float y) {}
@@ -0,0 +1,283 @@
+// Map file and kinematic body tests: writes small .lmap files and reads them
+// back through open_map_file(), map_file_get() and body_step(). `make test`
+// builds it natively with AddressSanitizer.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "drawlist.h"
+#include "mapfile.h"
+#include "body.h"
+
+Drawlist drawlist;
+SpritesInMemory sprites_in_memory;
+int current_frame;
+const int screenWidth = 480, screenHeight = 270;
+
+#define MAP_PATH "../build/tests/test_maps.lmap"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+} while (0)
+
+static void write_u16(FILE *file, int value) {
+    fputc(value & 0xFF, file);
+    fputc((value >> 8) & 0xFF, file);
+}
+
+static void write_u32(FILE *file, uint32_t value) {
+    write_u16(file, value & 0xFFFF);
+    write_u16(file, value >> 16);
+}
+
+//----------------------------------------------------------------------------------
+// Writes cells (layers * height * width values, layer after layer) as a map file,
+// one run per cell
+//----------------------------------------------------------------------------------
+static void write_map_file(const char *path, int width, int height, int layers, int chunk_size, const uint16_t *cells) {
+    FILE *file = fopen(path, "wb");
+    fwrite("LMAP", 1, 4, file);
+    write_u16(file, 1);
+    write_u16(file, width);
+    write_u16(file, height);
+    write_u16(file, layers);
+    write_u16(file, chunk_size);
+    write_u16(file, 0);
+
+    if (chunk_size == 0) {
+        fclose(file);
+        return;
+    }
+
+    int chunks_x = (width + chunk_size - 1) / chunk_size;
+    int chunks_y = (height + chunk_size - 1) / chunk_size;
+    uint32_t chunk_length = layers * chunk_size * chunk_size * 4;
+    uint32_t offset = 16 + chunks_x * chunks_y * 8;
+
+    for (int i = 0; i < chunks_x * chunks_y; i++) {
+        write_u32(file, offset + i * chunk_length);
+        write_u32(file, chunk_length);
+    }
+
+    for (int cy = 0; cy < chunks_y; cy++) {
+        for (int cx = 0; cx < chunks_x; cx++) {
+            for (int layer = 0; layer < layers; layer++) {
+                for (int y = cy * chunk_size; y < (cy + 1) * chunk_size; y++) {
+                    for (int x = cx * chunk_size; x < (cx + 1) * chunk_size; x++) {
+                        bool inside = x < width && y < height;
+                        write_u16(file, 1);
+                        write_u16(file, inside ? cells[(layer * height + y) * width + x] : 0);
+                    }
+                }
+            }
+        }
+    }
+
+    fclose(file);
+}
+
+static void test_reject_empty_header() {
+    write_map_file(MAP_PATH, 8, 8, 1, 0, NULL);
+    CHECK(open_map_file(MAP_PATH) == 0);
+
+    write_map_file(MAP_PATH, 8, 8, 0, 4, NULL);
+    CHECK(open_map_file(MAP_PATH) == 0);
+}
+
+static void test_get_decodes_chunk() {
+    // 8x4 cells in two 4x4 chunks, two layers
+    uint16_t cells[2 * 4 * 8];
+    for (int i = 0; i < 4 * 8; i++) {
+        cells[i] = i + 1;
+        cells[4 * 8 + i] = 100 + i;
+    }
+    write_map_file(MAP_PATH, 8, 4, 2, 4, cells);
+
+    int id = open_map_file(MAP_PATH);
+    CHECK(id != 0);
+    MapFile *map = get_map_file(id);
+    if (map == NULL) return;
+
+    int resident = map_chunks_resident;
+    CHECK(map->chunks[1] == NULL);
+
+    // Reading from the second chunk decodes only that chunk
+    CHECK(map_file_get(map, 0, 5, 2) == 2 * 8 + 5 + 1);
+    CHECK(map_file_get(map, 1, 7, 3) == 100 + 3 * 8 + 7);
+    CHECK(map->chunks[1] != NULL && map->chunks[0] == NULL);
+    CHECK(map_chunks_resident == resident + 1);
+
+    CHECK(map_file_get(map, 0, 0, 0) == 1);
+    CHECK(map_file_get(map, 2, 0, 0) == 0);
+    CHECK(map_file_get(map, 0, 8, 0) == 0);
+    CHECK(map_file_get(map, 0, -1, 0) == 0);
+    CHECK(map_chunks_resident == resident + 2);
+
+    close_map_file(id);
+    CHECK(map_chunks_resident == resident);
+    CHECK(get_map_file(id) == NULL);
+}
+
+static void test_stream_keeps_read_chunks() {
+    // 4 chunks of 256 cells, the screen and its margin only cover the first three
+    int width = 4 * 256;
+    uint16_t *cells = (uint16_t *) calloc(width * 16, sizeof(uint16_t));
+    cells[16 * width - 1] = 7;
+    write_map_file(MAP_PATH, width, 16, 1, 256, cells);
+    free(cells);
+
+    int id = open_map_file(MAP_PATH);
+    MapFile *map = get_map_file(id);
+    CHECK(map != NULL && map->chunks_x == 4);
+    if (map == NULL) return;
+
+    // An off-screen reader touches the last chunk every frame
+    for (current_frame = 1; current_frame <= 3; current_frame++) {
+        CHECK(map_file_get(map, 0, width - 1, 15) == 7);
+        map_file_stream(map, 0, 0, 1);
+        CHECK(map->chunks[3] != NULL);
+    }
+
+    // Unread for two frames it is dropped
+    map_file_stream(map, 0, 0, 1);
+    current_frame++;
+    map_file_stream(map, 0, 0, 1);
+    CHECK(map->chunks[3] == NULL);
+    CHECK(map->chunks[0] != NULL);
+
+    close_map_file(id);
+}
+
+//----------------------------------------------------------------------------------
+// A 16x16 map of 16px tiles: walls (1) in columns 2 and 10, a ceiling (1) in row 1
+// and a one-way platform (2) in row 12 between them; returns a 16x16 body in it
+//----------------------------------------------------------------------------------
+static int create_room_body() {
+    uint16_t cells[16 * 16] = {0};
+    for (int i = 0; i < 16; i++) {
+        cells[i * 16 + 2] = 1;
+        cells[i * 16 + 10] = 1;
+    }
+    for (int x = 3; x < 10; x++) {
+        cells[1 * 16 + x] = 1;
+        cells[12 * 16 + x] = 2;
+    }
+    write_map_file(MAP_PATH, 16, 16, 1, 16, cells);
+
+    KinematicBody settings = {0};
+    settings.map_file = open_map_file(MAP_PATH);
+    settings.tile_size = 16;
+    settings.solids[0] = (BodySolid) { 1, SOLID_TOP | SOLID_BOTTOM | SOLID_LEFT | SOLID_RIGHT };
+    settings.solids[1] = (BodySolid) { 2, SOLID_BOTTOM };
+    settings.solid_count = 2;
+    settings.width = 16;
+    settings.height = 16;
+    settings.max_fall = INFINITY;
+    settings.foot_inset = 4;
+    settings.head = 4;
+    settings.side_inset = 2;
+    settings.side_reach = 12;
+
+    return create_body(settings);
+}
+
+static void delete_room_body(int id) {
+    close_map_file(get_body(id)->map_file);
+    delete_body(id);
+}
+
+static void test_body_walls() {
+    int id = create_room_body();
+    KinematicBody *body = get_body(id);
+
+    // Fast enough to cross the wall in one frame without sub-steps
+    double x = 100, y = 64, vx = 100, vy = 0;
+    int contacts = 0;
+    for (int frame = 0; frame < 4 && contacts == 0; frame++) {
+        contacts = body_step(body, &x, &y, &vx, &vy);
+    }
+    CHECK(contacts == CONTACT_RIGHT);
+    CHECK(vx == 0);
+    CHECK(x + body->side_inset < 176);
+
+    x = 100, vx = -100, contacts = 0;
+    for (int frame = 0; frame < 4 && contacts == 0; frame++) {
+        contacts = body_step(body, &x, &y, &vx, &vy);
+    }
+    CHECK(contacts == CONTACT_LEFT);
+    CHECK(vx == 0);
+    CHECK(x + body->width - body->side_inset > 32);
+    CHECK(y == 64);
+
+    delete_room_body(id);
+}
+
+static void test_body_one_way_platform() {
+    int id = create_room_body();
+    KinematicBody *body = get_body(id);
+    body->gravity = 1;
+
+    // Falling from rest lands on top of the platform
+    double x = 80, y = 100, vx = 0, vy = 0;
+    int contacts = 0;
+    for (int frame = 0; frame < 60 && contacts == 0; frame++) {
+        contacts = body_step(body, &x, &y, &vx, &vy);
+    }
+    CHECK(contacts == CONTACT_GROUND);
+    CHECK(vy == 0);
+    CHECK(fabs(y - (192 - 16)) < 0.01);
+
+    // So does falling more than a tile a frame
+    y = 40, vy = 300;
+    CHECK(body_step(body, &x, &y, &vx, &vy) == CONTACT_GROUND);
+    CHECK(fabs(y - (192 - 16)) < 0.01);
+
+    // Jumping from below passes through it
+    body->gravity = 0;
+    y = 220, vy = -20;
+    for (int frame = 0; frame < 3; frame++) {
+        CHECK(body_step(body, &x, &y, &vx, &vy) == 0);
+    }
+    CHECK(y == 160);
+    CHECK(vy == -20);
+
+    delete_room_body(id);
+}
+
+static void test_body_ceiling() {
+    int id = create_room_body();
+    KinematicBody *body = get_body(id);
+
+    double x = 80, y = 60, vx = 0, vy = -10;
+    int contacts = 0;
+    for (int frame = 0; frame < 10 && contacts == 0; frame++) {
+        contacts = body_step(body, &x, &y, &vx, &vy);
+    }
+    CHECK(contacts == CONTACT_CEILING);
+    CHECK(vy == 0);
+    CHECK(y + body->head >= 16);
+
+    delete_room_body(id);
+}
+
+int main() {
+    test_reject_empty_header();
+    test_get_decodes_chunk();
+    test_stream_keeps_read_chunks();
+    test_body_walls();
+    test_body_one_way_platform();
+    test_body_ceiling();
+
+    remove(MAP_PATH);
+
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("All map tests passed\n");
+    return 0;
+}
@@ -0,0 +1,155 @@
+// Sprite sheet registration tests: registers sheets the way SpriteSheets does
+// at startup and checks the stored data, the trimmed, packed layout and which
+// asset group keeps them.
+// `make test` builds it natively with AddressSanitizer.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drawlist.h"
+#include "assets.h"
+
+Drawlist drawlist;
+SpritesInMemory sprites_in_memory;
+int current_frame;
+const int screenWidth = 480, screenHeight = 270;
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+} while (0)
+
+static char *make_tiles(int width, int height, int ntiles, char fill) {
+    char *data = (char *) malloc(width * height * ntiles);
+    memset(data, fill, width * height * ntiles);
+    return data;
+}
+
+static void test_register_sheet() {
+    // 8x8 tiles: one opaque, one with a 2x3 box at (4, 2), one empty
+    char *data = make_tiles(8, 8, 3, 0);
+    memset(data, 5, 64);
+    for (int y = 2; y < 5; y++) {
+        data[64 + y * 8 + 4] = 7;
+        data[64 + y * 8 + 5] = 7;
+    }
+
+    add_sprite_in_memory("tiles", data, 8, 8, 3, 0);
+
+    SpriteInMemory *sprite = get_sprite_in_memory("tiles");
+    CHECK(sprite != NULL);
+    if (sprite == NULL) { free(data); return; }
+
+    CHECK(sprite->ntiles == 3);
+    CHECK(memcmp(sprite->data, data, 8 * 8 * 3) == 0);
+
+    SheetRect *full = &sprite->tile_rects[0];
+    CHECK(full->src.width == 8 && full->src.height == 8);
+    CHECK(full->offset_x == 0 && full->offset_y == 0);
+
+    SheetRect *box = &sprite->tile_rects[1];
+    CHECK(box->src.width == 2 && box->src.height == 3);
+    CHECK(box->offset_x == 4 && box->offset_y == 2);
+
+    CHECK(sprite->tile_rects[2].src.width == 0);
+    CHECK(sprite->sheet_width * sprite->sheet_height >= 8 * 8 + 2 * 3);
+
+    free(data);
+}
+
+static void test_tall_sheet() {
+    // One column would be 4800 pixels tall; packed wider it fits
+    char *data = make_tiles(16, 16, 300, 1);
+    add_sprite_in_memory("tall", data, 16, 16, 300, 1);
+
+    SpriteInMemory *sprite = get_sprite_in_memory("tall");
+    CHECK(sprite != NULL);
+    if (sprite != NULL) {
+        CHECK(sprite->sheet_width <= MAX_SHEET_TEXTURE_SIZE);
+        CHECK(sprite->sheet_height <= MAX_SHEET_TEXTURE_SIZE);
+    }
+
+    free(data);
+}
+
+static void test_oversized_sheet() {
+    // 70000 opaque 16x16 tiles can't fit in 4096x4096 at any width
+    char *data = make_tiles(16, 16, 70000, 1);
+    add_sprite_in_memory("huge", data, 16, 16, 70000, 0);
+
+    CHECK(get_sprite_in_memory("huge") == NULL);
+
+    free(data);
+}
+
+static void test_tile_flags() {
+    int tile_index, flags;
+
+    // Small sheets carry flags above the index bits
+    SpriteInMemory *tall = get_sprite_in_memory("tall");
+    CHECK(tall != NULL);
+    if (tall != NULL) {
+        split_tile_value(tall, 5 + TILE_FLIP_X + TILE_DIAGONAL, &tile_index, &flags);
+        CHECK(tile_index == 5 && flags == (TILE_FLIP_X | TILE_DIAGONAL));
+    }
+
+    // Larger ones need those bits for the index
+    char *data = make_tiles(8, 8, 1500, 1);
+    add_sprite_in_memory("many", data, 8, 8, 1500, 0);
+
+    SpriteInMemory *many = get_sprite_in_memory("many");
+    CHECK(many != NULL);
+    if (many != NULL) {
+        split_tile_value(many, 1029, &tile_index, &flags);
+        CHECK(tile_index == 1029 && flags == 0);
+    }
+
+    free(data);
+}
+
+static void test_replayed_list_keeps_sheet() {
+    SpriteInMemory *sheet = get_sprite_in_memory("tall");
+    CHECK(sheet != NULL);
+    if (sheet == NULL) return;
+
+    // Recorded in one group, the second list calling the first
+    begin_asset_group("title");
+    int tiles = begin_display_list();
+    add_tile(sheet, 0, 0, 0, 0);
+    end_display_list();
+    int calls = begin_display_list();
+    add_call_list(tiles, 0, 0);
+    end_display_list();
+    CHECK(sheet->group == get_asset_group("title"));
+
+    // Replayed in another, the sheet moves with it
+    begin_asset_group("level");
+    add_call_list(calls, 0, 0);
+    CHECK(sheet->group == get_asset_group("level"));
+
+    clear_drawlist();
+    delete_display_list(calls);
+    delete_display_list(tiles);
+    end_display_list_frame();
+    current_asset_group = 0;
+}
+
+int main() {
+    sprites_in_memory.max_count = 4;
+    sprites_in_memory.sprites = (SpriteInMemory **) calloc(sprites_in_memory.max_count, sizeof(SpriteInMemory *));
+
+    test_register_sheet();
+    test_tall_sheet();
+    test_oversized_sheet();
+    test_tile_flags();
+    test_replayed_list_keeps_sheet();
+
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("All sheet tests passed\n");
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Spatial hash tests: inserts, moves and removes boxes and checks what
+// spatial_hash_query() returns. `make test` builds it natively with
+// AddressSanitizer.
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "drawlist.h"
+#include "spatial.h"
+
+Drawlist drawlist;
+SpritesInMemory sprites_in_memory;
+int current_frame;
+const int screenWidth = 480, screenHeight = 270;
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } \
+} while (0)
+
+static int *results = NULL;
+static int max_results = 0;
+
+static int query(SpatialHash *hash, float x, float y, float width, float height) {
+    return spatial_hash_query(hash, (Rectangle) { x, y, width, height }, &results, &max_results);
+}
+
+static void test_query_dedup_and_order() {
+    int id = create_spatial_hash(16);
+    SpatialHash *hash = get_spatial_hash(id);
+
+    // Inserted out of order; entity 7 spans 3x3 cells
+    spatial_hash_set(hash, 9, (Rectangle) { 4, 4, 8, 8 });
+    spatial_hash_set(hash, 7, (Rectangle) { 8, 8, 32, 32 });
+    spatial_hash_set(hash, 2, (Rectangle) { 20, 20, 4, 4 });
+    spatial_hash_set(hash, 5, (Rectangle) { 200, 200, 4, 4 });
+
+    int count = query(hash, 0, 0, 48, 48);
+    CHECK(count == 3);
+    CHECK(count >= 3 && results[0] == 2 && results[1] == 7 && results[2] == 9);
+
+    // Overlapping the cells without touching the boxes
+    CHECK(query(hash, 44, 0, 3, 3) == 0);
+
+    spatial_hash_remove(hash, 7);
+    count = query(hash, 0, 0, 48, 48);
+    CHECK(count == 2 && results[0] == 2 && results[1] == 9);
+
+    delete_spatial_hash(id);
+}
+
+static void test_query_after_move() {
+    int id = create_spatial_hash(16);
+    SpatialHash *hash = get_spatial_hash(id);
+
+    spatial_hash_set(hash, 1, (Rectangle) { 0, 0, 8, 8 });
+
+    // Within the same cells, only the box changes
+    spatial_hash_set(hash, 1, (Rectangle) { 6, 6, 8, 8 });
+    CHECK(query(hash, 13, 13, 2, 2) == 1);
+    CHECK(query(hash, 0, 0, 4, 4) == 0);
+
+    // Across cells, the old ones forget it
+    spatial_hash_set(hash, 1, (Rectangle) { 100, 40, 8, 8 });
+    CHECK(query(hash, 0, 0, 16, 16) == 0);
+    CHECK(query(hash, 96, 32, 16, 16) == 1 && results[0] == 1);
+
+    delete_spatial_hash(id);
+}
+
+static void test_query_larger_than_buckets() {
+    int id = create_spatial_hash(1);
+    SpatialHash *hash = get_spatial_hash(id);
+
+    for (int i = 1; i <= 100; i++) {
+        spatial_hash_set(hash, i, (Rectangle) { i * 37 % 200, i * 11 % 150, 3, 3 });
+    }
+
+    // 200x150 one-pixel cells, far more than SPATIAL_BUCKETS
+    int count = query(hash, 0, 0, 200, 150);
+    CHECK(count == 100);
+
+    bool ascending = true;
+    for (int i = 0; i < count; i++) {
+        if (results[i] != i + 1) ascending = false;
+    }
+    CHECK(ascending);
+
+    delete_spatial_hash(id);
+}
+
+int main() {
+    test_query_dedup_and_order();
+    test_query_after_move();
+    test_query_larger_than_buckets();
+
+    free(results);
+
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("All spatial hash tests passed\n");
+    return 0;
+}
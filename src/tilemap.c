@@ -0,0 +1,408 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "drawlist.h"
+#include "tilemap.h"
+#include "assets.h"
+#include "registry.h"
+
+/*
+Global vars
+*/
+Registry tile_maps;
+BgLayer bg_layers[MAX_BG_LAYERS];
+extern const int screenWidth;
+extern const int screenHeight;
+
+// Render textures given back while the frame is built. Chunks queued earlier
+// in the frame may still draw them, so they are unloaded once it was drawn
+static RenderTexture2D *pending_unloads = NULL;
+static int pending_unload_count = 0;
+static int pending_unload_max = 0;
+
+static void unload_render_texture_later(RenderTexture2D target) {
+    if (pending_unload_count == pending_unload_max) {
+        pending_unload_max = pending_unload_max == 0 ? 16 : pending_unload_max * 2;
+        pending_unloads = (RenderTexture2D *) realloc(pending_unloads, sizeof(RenderTexture2D) * pending_unload_max);
+    }
+
+    pending_unloads[pending_unload_count++] = target;
+}
+
+/**
+Tile Map Functions
+**/
+int create_tilemap(int width, int height, int tile_size) {
+    TileMap *map = (TileMap *) malloc(sizeof(TileMap));
+    map->width = width;
+    map->height = height;
+    map->tile_size = tile_size;
+    map->group = current_asset_group;
+    map->tiles = (uint16_t *) calloc(width * height, sizeof(uint16_t));
+
+    map->chunks_x = (width + TILEMAP_CHUNK_TILES - 1) / TILEMAP_CHUNK_TILES;
+    map->chunks_y = (height + TILEMAP_CHUNK_TILES - 1) / TILEMAP_CHUNK_TILES;
+    map->chunks = (TileMapChunk *) calloc(map->chunks_x * map->chunks_y, sizeof(TileMapChunk));
+
+    map->diff_from = NULL;
+    map->diff_to = NULL;
+    map->tile_changed = NULL;
+
+    return registry_add(&tile_maps, map);
+}
+
+TileMap* get_tilemap(int id) {
+    return (TileMap *) registry_get(&tile_maps, id);
+}
+
+void delete_tilemap(int id) {
+    TileMap *map = get_tilemap(id);
+    if (map == NULL) return;
+
+    for (int i = 0; i < map->chunks_x * map->chunks_y; i++) {
+        if (map->chunks[i].target.id != 0) {
+            unload_render_texture_later(map->chunks[i].target);
+        }
+        free(map->chunks[i].anim_cells);
+    }
+
+    free(map->chunks);
+    free(map->tiles);
+    free(map->tile_changed);
+    free(map);
+    registry_remove(&tile_maps, id);
+}
+
+uint16_t tilemap_get(TileMap *map, int x, int y) {
+    if (x < 0 || y < 0 || x >= map->width || y >= map->height) return 0;
+    return map->tiles[y * map->width + x];
+}
+
+void tilemap_set(TileMap *map, int x, int y, uint16_t value) {
+    if (x < 0 || y < 0 || x >= map->width || y >= map->height) return;
+    if (map->tiles[y * map->width + x] == value) return;
+
+    map->tiles[y * map->width + x] = value;
+
+    int chunk_index = (y / TILEMAP_CHUNK_TILES) * map->chunks_x + (x / TILEMAP_CHUNK_TILES);
+    map->chunks[chunk_index].dirty = true;
+}
+
+//----------------------------------------------------------------------------------
+// Marks which tiles look different between two tilesets, so swapping between
+// animation frames of a sheet only rebuilds the chunks using the animated tiles
+//----------------------------------------------------------------------------------
+static void tilemap_diff_tilesets(TileMap *map, SpriteInMemory *from, SpriteInMemory *to) {
+    if (map->diff_from == from && map->diff_to == to) return;
+
+    map->diff_from = from;
+    map->diff_to = to;
+    map->tile_changed = (bool *) realloc(map->tile_changed, sizeof(bool) * to->ntiles);
+
+    bool same_layout = from->tile_width == to->tile_width && from->tile_height == to->tile_height
+        && from->data != NULL && to->data != NULL;
+    int tile_bytes = to->tile_width * to->tile_height;
+
+    for (int i = 0; i < to->ntiles; i++) {
+        if (!same_layout || i >= from->ntiles) {
+            map->tile_changed[i] = true;
+        } else {
+            map->tile_changed[i] = memcmp(from->data + i * tile_bytes, to->data + i * tile_bytes, tile_bytes) != 0;
+        }
+    }
+}
+
+static bool tilemap_chunk_needs_rebuild(TileMap *map, int cx, int cy, SpriteInMemory *tileset) {
+    TileMapChunk *chunk = &map->chunks[cy * map->chunks_x + cx];
+
+    if (chunk->dirty || chunk->target.id == 0) return true;
+    if (chunk->tileset == tileset) return chunk->anim_version != tileset->anim_version;
+    if (tileset->tile_anims != NULL || chunk->tileset->tile_anims != NULL) return true;
+
+    tilemap_diff_tilesets(map, chunk->tileset, tileset);
+
+    for (int y = cy * TILEMAP_CHUNK_TILES; y < (cy + 1) * TILEMAP_CHUNK_TILES; y++) {
+        for (int x = cx * TILEMAP_CHUNK_TILES; x < (cx + 1) * TILEMAP_CHUNK_TILES; x++) {
+            uint16_t value = tilemap_get(map, x, y);
+            if (value == 0) continue;
+
+            // A tile past the end of the new sheet only matters if the old one drew it
+            int tile_index = (value - 1) & TILE_INDEX_MASK;
+            if (tile_index >= tileset->ntiles) {
+                if (tile_index < chunk->tileset->ntiles) return true;
+                continue;
+            }
+            if (map->tile_changed[tile_index]) return true;
+        }
+    }
+
+    // Nothing in this chunk differs between the two sheets
+    chunk->tileset = tileset;
+    return false;
+}
+
+static void tilemap_render_chunk(TileMap *map, int cx, int cy, SpriteInMemory *tileset) {
+    TileMapChunk *chunk = &map->chunks[cy * map->chunks_x + cx];
+    int chunk_size = TILEMAP_CHUNK_TILES * map->tile_size;
+
+    if (chunk->target.id == 0) {
+        chunk->target = LoadRenderTexture(chunk_size, chunk_size);
+    }
+
+    chunk->anim_count = 0;
+
+    BeginTextureMode(chunk->target);
+    ClearBackground(BLANK);
+
+    for (int ty = 0; ty < TILEMAP_CHUNK_TILES; ty++) {
+        for (int tx = 0; tx < TILEMAP_CHUNK_TILES; tx++) {
+            uint16_t value = tilemap_get(map, cx * TILEMAP_CHUNK_TILES + tx, cy * TILEMAP_CHUNK_TILES + ty);
+            if (value == 0) continue;
+
+            // Animated tiles are left out of the texture and drawn on top every frame
+            if (sprite_in_memory_tile_is_animated(tileset, (value - 1) & TILE_INDEX_MASK)) {
+                if (chunk->anim_cells == NULL) {
+                    chunk->anim_cells = (uint16_t *) malloc(sizeof(uint16_t) * TILEMAP_CHUNK_TILES * TILEMAP_CHUNK_TILES);
+                }
+                chunk->anim_cells[chunk->anim_count++] = ty * TILEMAP_CHUNK_TILES + tx;
+                continue;
+            }
+
+            TileItem tile = {
+                .sprite_in_memory = tileset,
+                .tile_index = (value - 1) & TILE_INDEX_MASK,
+                .x = tx * map->tile_size,
+                .y = ty * map->tile_size,
+                .flags = (value - 1) & TILE_FLAGS
+            };
+            draw_tile(&tile);
+        }
+    }
+
+    EndTextureMode();
+
+    chunk->tileset = tileset;
+    chunk->anim_version = tileset->anim_version;
+    chunk->dirty = false;
+}
+
+//----------------------------------------------------------------------------------
+// Adds the tiles of every visible cell; used while a display list is recorded,
+// since the list can outlive the chunk render textures
+//----------------------------------------------------------------------------------
+static void add_tilemap_tiles(TileMap *map, SpriteInMemory *tileset, int camx, int camy) {
+    int x_start = camx < 0 ? 0 : camx / map->tile_size;
+    int y_start = camy < 0 ? 0 : camy / map->tile_size;
+    int x_end = (camx + screenWidth - 1) / map->tile_size;
+    int y_end = (camy + screenHeight - 1) / map->tile_size;
+
+    for (int y = y_start; y <= y_end && y < map->height; y++) {
+        for (int x = x_start; x <= x_end && x < map->width; x++) {
+            int value = tilemap_get(map, x, y) - 1;
+            if (value < 0) continue;
+
+            add_tile(tileset, value & TILE_INDEX_MASK, x * map->tile_size - camx, y * map->tile_size - camy, value & TILE_FLAGS);
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------
+// Adds the chunks visible from (camx, camy), rebuilding the ones that changed.
+// Chunks far from the camera give their render texture back.
+//----------------------------------------------------------------------------------
+void add_tilemap(TileMap *map, SpriteInMemory *tileset, int camx, int camy) {
+    if (tileset == NULL) return;
+
+    mark_asset_used(tileset);
+
+    if (get_recording_display_list() != NULL) {
+        add_tilemap_tiles(map, tileset, camx, camy);
+        return;
+    }
+
+    int chunk_size = TILEMAP_CHUNK_TILES * map->tile_size;
+    int cx_start = camx < 0 ? 0 : camx / chunk_size;
+    int cy_start = camy < 0 ? 0 : camy / chunk_size;
+    int cx_end = (camx + screenWidth - 1) / chunk_size;
+    int cy_end = (camy + screenHeight - 1) / chunk_size;
+
+    if (cx_end >= map->chunks_x) cx_end = map->chunks_x - 1;
+    if (cy_end >= map->chunks_y) cy_end = map->chunks_y - 1;
+
+    for (int cy = cy_start; cy <= cy_end; cy++) {
+        for (int cx = cx_start; cx <= cx_end; cx++) {
+            if (tilemap_chunk_needs_rebuild(map, cx, cy, tileset)) {
+                tilemap_render_chunk(map, cx, cy, tileset);
+            }
+
+            TileMapChunk *chunk = &map->chunks[cy * map->chunks_x + cx];
+            add_chunk(chunk->target.texture, cx * chunk_size - camx, cy * chunk_size - camy);
+
+            for (int i = 0; i < chunk->anim_count; i++) {
+                int x = cx * TILEMAP_CHUNK_TILES + chunk->anim_cells[i] % TILEMAP_CHUNK_TILES;
+                int y = cy * TILEMAP_CHUNK_TILES + chunk->anim_cells[i] / TILEMAP_CHUNK_TILES;
+                int value = tilemap_get(map, x, y) - 1;
+
+                add_tile(tileset, value & TILE_INDEX_MASK, x * map->tile_size - camx, y * map->tile_size - camy, value & TILE_FLAGS);
+            }
+        }
+    }
+
+    for (int cy = 0; cy < map->chunks_y; cy++) {
+        for (int cx = 0; cx < map->chunks_x; cx++) {
+            TileMapChunk *chunk = &map->chunks[cy * map->chunks_x + cx];
+            bool near = cx >= cx_start - 1 && cx <= cx_end + 1 && cy >= cy_start - 1 && cy <= cy_end + 1;
+
+            if (!near && chunk->target.id != 0) {
+                unload_render_texture_later(chunk->target);
+                chunk->target.id = 0;
+            }
+        }
+    }
+}
+
+/**
+Background Layer Functions
+**/
+void set_bg_layer(int layer, SpriteInMemory *tileset, uint16_t *pattern, int pattern_length, int y, float scroll_x, float scroll_y, int max_scroll_y) {
+    if (layer < 0 || layer >= MAX_BG_LAYERS) return;
+
+    BgLayer *bg = &bg_layers[layer];
+    mark_asset_used(tileset);
+
+    free(bg->pattern);
+    bg->pattern = (uint16_t *) malloc(sizeof(uint16_t) * pattern_length);
+    memcpy(bg->pattern, pattern, sizeof(uint16_t) * pattern_length);
+    bg->pattern_length = pattern_length;
+
+    bg->tileset = tileset;
+    bg->y = y;
+    bg->scroll_x = scroll_x;
+    bg->scroll_y = scroll_y;
+    bg->max_scroll_y = max_scroll_y;
+    bg->dirty = true;
+    bg->group = current_asset_group;
+}
+
+//----------------------------------------------------------------------------------
+// Frees the layer's strip texture and pattern; it draws nothing until set again
+//----------------------------------------------------------------------------------
+void clear_bg_layer(int layer) {
+    if (layer < 0 || layer >= MAX_BG_LAYERS) return;
+
+    BgLayer *bg = &bg_layers[layer];
+
+    if (bg->strip.id != 0) {
+        unload_render_texture_later(bg->strip);
+        bg->strip.id = 0;
+    }
+
+    free(bg->pattern);
+    bg->pattern = NULL;
+    bg->pattern_length = 0;
+    bg->tileset = NULL;
+    bg->group = 0;
+}
+
+static void bg_layer_render_strip(BgLayer *bg) {
+    int width = bg->pattern_length * bg->tileset->tile_width;
+    int height = bg->tileset->tile_height;
+
+    if (bg->strip.id != 0 && (bg->strip.texture.width != width || bg->strip.texture.height != height)) {
+        unload_render_texture_later(bg->strip);
+        bg->strip.id = 0;
+    }
+
+    if (bg->strip.id == 0) {
+        bg->strip = LoadRenderTexture(width, height);
+    }
+
+    BeginTextureMode(bg->strip);
+    ClearBackground(BLANK);
+
+    for (int i = 0; i < bg->pattern_length; i++) {
+        TileItem tile = {
+            .sprite_in_memory = bg->tileset,
+            .tile_index = bg->pattern[i] & TILE_INDEX_MASK,
+            .x = i * bg->tileset->tile_width,
+            .y = 0,
+            .flags = bg->pattern[i] & TILE_FLAGS
+        };
+        draw_tile(&tile);
+    }
+
+    EndTextureMode();
+
+    bg->dirty = false;
+}
+
+//----------------------------------------------------------------------------------
+// Adds a background layer scrolled for the camera at (camx, camy).
+// The pattern is rendered once into a strip, then repeated across the screen.
+//----------------------------------------------------------------------------------
+void add_bg_layer(int layer, int camx, int camy) {
+    if (layer < 0 || layer >= MAX_BG_LAYERS) return;
+
+    BgLayer *bg = &bg_layers[layer];
+    if (bg->tileset == NULL || bg->pattern_length == 0) return;
+
+    if (bg->dirty || bg->strip.id == 0) {
+        bg_layer_render_strip(bg);
+    }
+
+    // The epsilon keeps factors like 1/5 from landing just under a whole pixel
+    int wrap = bg->strip.texture.width;
+    int dx = (int) floor(camx * (double) bg->scroll_x + 1e-6);
+    double scroll_y = camy * (double) bg->scroll_y;
+    if (scroll_y > bg->max_scroll_y) scroll_y = bg->max_scroll_y;
+    int dy = (int) floor(scroll_y + 1e-6);
+
+    int start_x = -(((dx % wrap) + wrap) % wrap);
+    for (int x = start_x; x < screenWidth; x += wrap) {
+        if (get_recording_display_list() == NULL) {
+            add_chunk(bg->strip.texture, x, bg->y - dy);
+            continue;
+        }
+
+        // A display list can outlive the strip, so it records the tiles
+        for (int i = 0; i < bg->pattern_length; i++) {
+            int tile_x = x + i * bg->tileset->tile_width;
+            add_tile(bg->tileset, bg->pattern[i] & TILE_INDEX_MASK, tile_x, bg->y - dy, bg->pattern[i] & TILE_FLAGS);
+        }
+    }
+}
+
+/**
+Chunk Functions
+**/
+//----------------------------------------------------------------------------------
+// After the frame was drawn: unloads the chunk and strip render textures given
+// back during it
+//----------------------------------------------------------------------------------
+void end_tilemap_frame() {
+    for (int i = 0; i < pending_unload_count; i++) {
+        UnloadRenderTexture(pending_unloads[i]);
+    }
+
+    pending_unload_count = 0;
+}
+
+void add_chunk(Texture2D texture, int x, int y) {
+    ChunkItem *chunk = (ChunkItem *) malloc(sizeof(ChunkItem));
+    chunk->texture = texture;
+    chunk->x = x;
+    chunk->y = y;
+
+    add_drawable(chunk, 'm');
+}
+
+void draw_chunk(ChunkItem *chunk) {
+    // Render textures are stored upside down
+    DrawTextureRec(
+        chunk->texture,
+        (Rectangle) { 0, 0, chunk->texture.width, -chunk->texture.height },
+        (Vector2) { chunk->x, chunk->y },
+        WHITE
+    );
+}
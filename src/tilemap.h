@@ -0,0 +1,29 @@
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include "types.h"
+
+/*
+Tile Map Functions
+*/
+extern Registry tile_maps;
+int create_tilemap(int width, int height, int tile_size);
+TileMap* get_tilemap(int id);
+void delete_tilemap(int id);
+uint16_t tilemap_get(TileMap *map, int x, int y);
+void tilemap_set(TileMap *map, int x, int y, uint16_t value);
+void add_tilemap(TileMap *map, SpriteInMemory *tileset, int camx, int camy);
+
+/*
+Background Layer Functions
+*/
+extern BgLayer bg_layers[MAX_BG_LAYERS];
+void set_bg_layer(int layer, SpriteInMemory *tileset, uint16_t *pattern, int pattern_length, int y, float scroll_x, float scroll_y, int max_scroll_y);
+void clear_bg_layer(int layer);
+void add_bg_layer(int layer, int camx, int camy);
+
+void add_chunk(Texture2D texture, int x, int y);
+void draw_chunk(ChunkItem *chunk);
+void end_tilemap_frame();
+
+#endif
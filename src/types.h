@@ -2,9 +2,18 @@
 #define TYPES_H
 
 #include "raylib.h"
+#include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 
+// Registry
+// Native objects handed to Lua as ids; id n is slot n - 1, NULL once removed
+typedef struct {
+    void **items;
+    int count;
+    int max_count;
+} Registry;
+
 // Text
 #define MAX_TEXT_LENGTH 100
 typedef struct {
@@ -13,6 +22,7 @@ typedef struct {
     int y;
     int fontSize;
     Color color;
+    bool owns_text;
 } TextItem;
 
 // Line
@@ -58,14 +68,46 @@ typedef struct {
     Color color;
 } TriangleItem;
 
+// Tile Animation
+// Tile indexes shown in turn, each for cadency frames; frame_count 0 means static
+typedef struct {
+    uint16_t *frames;
+    int frame_count;
+    int cadency;
+} TileAnim;
+
+// Sheet Rect
+// Where a tile's opaque part sits in the sheet texture, and where inside the full tile
+typedef struct {
+    Rectangle src;
+    int offset_x;
+    int offset_y;
+} SheetRect;
+
 // Sprite In Memory
+// Tiles are trimmed to their opaque part and packed on shelves columns tiles wide;
+// tile_rects holds each tile's place in the texture. sheet_ntiles is the count the
+// sheet was added with, before merge_tile_anim_sheets() appends frame tiles.
 #define MAX_SPRITE_NAME_LENGTH 256
+#define MAX_SHEET_TEXTURE_SIZE 4096
 typedef struct {
     char name[MAX_SPRITE_NAME_LENGTH];
     Texture2D texture;
+    unsigned char *data;
     int tile_width;
     int tile_height;
     int ntiles;
+    int sheet_ntiles;
+    int columns;
+    int sheet_width;
+    int sheet_height;
+    SheetRect *tile_rects;
+    TileAnim *tile_anims;
+    int anim_version;
+    int group;
+    bool derived;
+    int last_used;
+    bool evicted;
 } SpriteInMemory;
 
 // Sprites In Memory
@@ -75,13 +117,102 @@ typedef struct {
     int max_count;
 } SpritesInMemory;
 
+// Decode Job
+// A range of tiles of one sheet to expand from palette indices to RGBA
+typedef struct {
+    SpriteInMemory *sprite;
+    Color *pixels;
+    int first_tile;
+    int last_tile;
+} DecodeJob;
+
+// Texture Stats
+// Counters run for the current second; the rates hold the last full second
+typedef struct {
+    int resident_bytes;
+    int budget_bytes;
+    int evictions;
+    int reloads;
+    int evictions_per_sec;
+    int reloads_per_sec;
+    double window_start;
+} TextureStats;
+
+// Lua Memory Pools
+// Small Lua blocks come from fixed-size classes (16-byte steps); larger ones
+// go to the system allocator
+#define LUA_POOL_GRANULARITY 16
+#define LUA_POOL_CLASSES 16
+#define LUA_POOL_PAGE_SIZE (16 * 1024)
+typedef struct {
+    void *free_list;
+    int block_size;
+    int pages;
+    int used;
+    int free;
+    int allocations;
+} LuaPoolClass;
+
+typedef struct {
+    LuaPoolClass classes[LUA_POOL_CLASSES];
+    size_t pool_bytes;
+    size_t large_bytes;
+    int large_blocks;
+} LuaMemory;
+
+// Lua Allocation Sites
+// One per source line that allocated while profiling; "last" holds the
+// previous frame, "frame" the one in progress
+#define ALLOC_SITE_SOURCE_SIZE 60 // LUA_IDSIZE
+typedef struct {
+    const char *key;
+    int line;
+    char source[ALLOC_SITE_SOURCE_SIZE];
+    int frame_bytes;
+    int frame_count;
+    int last_bytes;
+    int last_count;
+    double total_bytes;
+    double total_count;
+} AllocSite;
+
+typedef struct {
+    bool enabled;
+    AllocSite *sites;
+    int count;
+    int capacity;
+    int frames;
+    const char *current_key;
+    int current_line;
+    char current_source[ALLOC_SITE_SOURCE_SIZE];
+} AllocProfile;
+
+// Lua GC Pacing
+// Collection runs in the time left in each frame instead of when Lua decides
+typedef struct {
+    bool in_cycle;
+    int pending_cycles;
+    int threshold_kb;
+    int steps;
+    int cycles;
+    double frame_ms;
+} LuaGc;
+
+// Tile Flags
+// Set above the 10-bit tile index; applied as diagonal, then x, then y (Tiled order)
+#define TILE_INDEX_MASK 1023
+#define TILE_FLIP_X 1024
+#define TILE_FLIP_Y 2048
+#define TILE_DIAGONAL 4096
+#define TILE_FLAGS (TILE_FLIP_X | TILE_FLIP_Y | TILE_DIAGONAL)
+
 // Tile Drawable
 typedef struct {
     SpriteInMemory *sprite_in_memory;
     int tile_index;
     int x;
     int y;
-    bool flipped;
+    int flags;
 } TileItem;
 
 // Sprite Drawable
@@ -97,6 +228,204 @@ typedef struct {
     Color color;
 } ClearItem;
 
+// Batch Drawable
+// Consecutive solid shapes of one color, merged into a single triangle list
+typedef struct {
+    Color color;
+    float *vertices;
+    int vertex_count;
+    int max_vertex_count;
+} BatchItem;
+
+// Map Chunk Drawable
+typedef struct {
+    Texture2D texture;
+    int x;
+    int y;
+} ChunkItem;
+
+// Tile Map
+// Tiles are stored as the map value (tile index + 1, 0 = empty) with its flip flags
+#define TILEMAP_CHUNK_TILES 16
+typedef struct {
+    RenderTexture2D target;
+    SpriteInMemory *tileset;
+    int anim_version;
+    uint16_t *anim_cells;
+    int anim_count;
+    bool dirty;
+} TileMapChunk;
+
+typedef struct {
+    int width;
+    int height;
+    int tile_size;
+    int group;
+    uint16_t *tiles;
+    int chunks_x;
+    int chunks_y;
+    TileMapChunk *chunks;
+    SpriteInMemory *diff_from;
+    SpriteInMemory *diff_to;
+    bool *tile_changed;
+} TileMap;
+
+// Map File
+// A binary map (.lmap) read from disk chunk by chunk; chunks[i] holds the decoded
+// cells of chunk i, layer after layer, or NULL while it is not resident.
+// chunk_frames[i] is the frame chunk i was last read in
+typedef struct {
+    FILE *file;
+    int width;
+    int height;
+    int layers;
+    int chunk_size;
+    int chunks_x;
+    int chunks_y;
+    uint32_t *chunk_offsets;
+    uint32_t *chunk_lengths;
+    uint16_t **chunks;
+    int *chunk_frames;
+    int group;
+} MapFile;
+
+// Spatial Hash
+// Entities are listed in the bucket of every cell their box touches; cells
+// that share a bucket are told apart by the box test in queries
+#define SPATIAL_BUCKETS 1024
+typedef struct {
+    int *ids;
+    int count;
+    int max_count;
+} SpatialBucket;
+
+typedef struct {
+    Rectangle box;
+    int cx0, cy0, cx1, cy1;
+    bool active;
+    unsigned int stamp;
+} SpatialEntity;
+
+typedef struct {
+    int cell_size;
+    SpatialBucket buckets[SPATIAL_BUCKETS];
+    SpatialEntity *entities;
+    int entity_count;
+    unsigned int stamp;
+    int group;
+} SpatialHash;
+
+// Particle Emitter
+// Particles are kept as one array per field so each update pass is a flat
+// loop over floats
+#define MAX_EMITTER_RAMP 8
+typedef struct {
+    float rate;
+    int lifetime;
+    float size;
+    float shrink;
+    float vx, vy;
+    float spread_x, spread_y;
+    float gravity;
+    int ramp[MAX_EMITTER_RAMP];
+    int ramp_count;
+} EmitterSettings;
+
+typedef struct {
+    EmitterSettings settings;
+    float *x, *y, *vx, *vy, *size;
+    int *age;
+    int count;
+    int max_count;
+    float spawn_x, spawn_y;
+    float spawn_budget;
+    bool armed;
+    int group;
+} ParticleEmitter;
+
+// Kinematic Body
+// Sensor points against the sides each collision tile value blocks
+// (bit n - 1 for kColisionType n: top, bottom, left, right)
+#define MAX_BODY_SOLIDS 16
+#define SOLID_TOP 1
+#define SOLID_BOTTOM 2
+#define SOLID_LEFT 4
+#define SOLID_RIGHT 8
+
+#define CONTACT_GROUND 1
+#define CONTACT_CEILING 2
+#define CONTACT_LEFT 4
+#define CONTACT_RIGHT 8
+
+typedef struct {
+    uint16_t value;
+    int sides;
+} BodySolid;
+
+typedef struct {
+    int map_file;
+    int layer;
+    int tile_size;
+    BodySolid solids[MAX_BODY_SOLIDS];
+    int solid_count;
+    double width, height;
+    double gravity, max_fall;
+    double foot_inset, head, side_inset, side_reach;
+    int group;
+} KinematicBody;
+
+// Input Snapshot
+// One bit per GamepadButton, sampled once at the start of each frame
+#define MAX_PADS 4
+#define PAD_BUTTONS (GAMEPAD_BUTTON_RIGHT_THUMB + 1)
+
+typedef struct {
+    uint32_t down;
+    uint32_t pressed;
+    uint32_t released;
+} PadState;
+
+typedef struct {
+    PadState pads[MAX_PADS];
+    int frame;
+} InputSnapshot;
+
+// Input Queue
+// Key presses with the time they arrived, folded into the next snapshot so a
+// press and release between two frames still counts as a press
+#define INPUT_QUEUE_SIZE 64
+
+typedef struct {
+    int key;
+    double time;
+} InputEvent;
+
+typedef struct {
+    InputEvent events[INPUT_QUEUE_SIZE];
+    int head;
+    int count;
+    int total;
+    int dropped;
+    double latency_ms;
+    double max_latency_ms;
+} InputQueue;
+
+// Background Layer
+// A repeating row of tiles scrolled by a fraction of the camera position
+#define MAX_BG_LAYERS 4
+typedef struct {
+    SpriteInMemory *tileset;
+    uint16_t *pattern;
+    int pattern_length;
+    int y;
+    float scroll_x;
+    float scroll_y;
+    int max_scroll_y;
+    RenderTexture2D strip;
+    bool dirty;
+    int group;
+} BgLayer;
+
 // List Objects
 typedef struct NodeDrawable NodeDrawable;
 
@@ -109,6 +438,23 @@ struct NodeDrawable{
 typedef struct {
     int count;
     NodeDrawable *root;
+    NodeDrawable *tail;
 } Drawlist;
 
+// Display List
+// A recorded drawlist that survives across frames and is replayed by id.
+// Deleted lists stay in their slot until the frame that may call them is drawn.
+typedef struct {
+    Drawlist items;
+    int group;
+    bool deleted;
+} DisplayList;
+
+// Call List Drawable
+typedef struct {
+    int list;
+    int x;
+    int y;
+} CallListItem;
+
 #endif // TYPES_H
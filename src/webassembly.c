@@ -1,4 +1,12 @@
 #include "drawlist.h"
+#include "tilemap.h"
+#include "assets.h"
+#include "decode.h"
+#include "luaalloc.h"
+#include "luagc.h"
+#include "bytecode.h"
+#include "luaprof.h"
+#include "input.h"
 
 #include <lua.h>
 #include <lualib.h>
@@ -11,6 +19,7 @@ Global objects
 Drawlist drawlist;
 lua_State *globalLuaState = NULL;
 SpritesInMemory sprites_in_memory;
+int current_frame = 0;
 
 /**
 Constants
@@ -18,6 +27,9 @@ Constants
 const int screenWidth = 480;
 const int screenHeight = 270;
 const int initial_sprites_in_memory_count = 10;
+const int preload_budget_bytes = 256 * 1024;
+const int default_texture_budget_bytes = 16 * 1024 * 1024;
+const int target_fps = 60;
 
 #if defined(PLATFORM_WEB)
     #include <emscripten/emscripten.h>
@@ -25,6 +37,12 @@ const int initial_sprites_in_memory_count = 10;
 
 void UpdateDrawFrame(void)
 {
+    double frame_start = GetTime();
+    current_frame++;
+
+    // Once per frame; ui.btn and ui.btnp read this snapshot
+    sample_input(current_frame);
+
     if (globalLuaState != NULL) {
         lua_getglobal(globalLuaState, "update");
         if (lua_isfunction(globalLuaState, -1)) {
@@ -37,6 +55,9 @@ void UpdateDrawFrame(void)
         }
     }
 
+    upload_requested_sprites();
+    process_preload_queue(preload_budget_bytes);
+
     BeginDrawing();
 
     ClearBackground(RAYWHITE);
@@ -52,9 +73,22 @@ void UpdateDrawFrame(void)
     DrawFPS(10, 10); // DEBUG
     #endif
 
+    // Before EndDrawing(), which waits out the rest of the frame on desktop
+    if (globalLuaState != NULL) {
+        step_lua_gc(globalLuaState, frame_start, 1.0 / target_fps);
+    }
+
     EndDrawing();
 
     clear_drawlist();
+
+    end_display_list_frame();
+    process_asset_releases();
+    end_tilemap_frame();
+    enforce_texture_budget();
+    update_texture_stats(GetTime());
+    end_alloc_profile_frame();
+    reset_box_scratch();
 }
 
 int main(void)
@@ -63,8 +97,9 @@ int main(void)
     sprites_in_memory.max_count = initial_sprites_in_memory_count;
     sprites_in_memory.sprites = (SpriteInMemory **) calloc(sprites_in_memory.max_count, sizeof(SpriteInMemory *));
 
-    globalLuaState = luaL_newstate();
+    globalLuaState = new_lua_state();
     luaL_openlibs(globalLuaState);
+    init_lua_gc(globalLuaState);
 
     lua_newtable(globalLuaState);
 
@@ -110,6 +145,69 @@ int main(void)
     lua_pushcfunction(globalLuaState, lua_log);
     lua_setfield(globalLuaState, -2, "log");
 
+    lua_pushcfunction(globalLuaState, lua_begin_list);
+    lua_setfield(globalLuaState, -2, "begin_list");
+
+    lua_pushcfunction(globalLuaState, lua_end_list);
+    lua_setfield(globalLuaState, -2, "end_list");
+
+    lua_pushcfunction(globalLuaState, lua_call_list);
+    lua_setfield(globalLuaState, -2, "call_list");
+
+    lua_pushcfunction(globalLuaState, lua_delete_list);
+    lua_setfield(globalLuaState, -2, "delete_list");
+
+    lua_pushcfunction(globalLuaState, lua_tilemap);
+    lua_setfield(globalLuaState, -2, "tilemap");
+
+    lua_pushcfunction(globalLuaState, lua_tilemap_draw);
+    lua_setfield(globalLuaState, -2, "tilemap_draw");
+
+    lua_pushcfunction(globalLuaState, lua_tilemap_set);
+    lua_setfield(globalLuaState, -2, "tilemap_set");
+
+    lua_pushcfunction(globalLuaState, lua_tilemap_free);
+    lua_setfield(globalLuaState, -2, "tilemap_free");
+
+    lua_pushcfunction(globalLuaState, lua_map_open);
+    lua_setfield(globalLuaState, -2, "map_open");
+
+    lua_pushcfunction(globalLuaState, lua_map_size);
+    lua_setfield(globalLuaState, -2, "map_size");
+
+    lua_pushcfunction(globalLuaState, lua_map_get);
+    lua_setfield(globalLuaState, -2, "map_get");
+
+    lua_pushcfunction(globalLuaState, lua_map_stream);
+    lua_setfield(globalLuaState, -2, "map_stream");
+
+    lua_pushcfunction(globalLuaState, lua_map_cells);
+    lua_setfield(globalLuaState, -2, "map_cells");
+
+    lua_pushcfunction(globalLuaState, lua_map_close);
+    lua_setfield(globalLuaState, -2, "map_close");
+
+    lua_pushcfunction(globalLuaState, lua_bg_layer);
+    lua_setfield(globalLuaState, -2, "bg_layer");
+
+    lua_pushcfunction(globalLuaState, lua_bg_draw);
+    lua_setfield(globalLuaState, -2, "bg_draw");
+
+    lua_pushcfunction(globalLuaState, lua_tile_anim);
+    lua_setfield(globalLuaState, -2, "tile_anim");
+
+    lua_pushcfunction(globalLuaState, lua_tile_anim_sheets);
+    lua_setfield(globalLuaState, -2, "tile_anim_sheets");
+
+    lua_pushcfunction(globalLuaState, lua_preload_spritesheet);
+    lua_setfield(globalLuaState, -2, "preload_spritesheet");
+
+    lua_pushcfunction(globalLuaState, lua_begin_assets);
+    lua_setfield(globalLuaState, -2, "begin_assets");
+
+    lua_pushcfunction(globalLuaState, lua_release_assets);
+    lua_setfield(globalLuaState, -2, "release_assets");
+
     // TODO
     lua_pushcfunction(globalLuaState, lua_camera);
     lua_setfield(globalLuaState, -2, "camera");
@@ -120,9 +218,6 @@ int main(void)
     lua_pushcfunction(globalLuaState, lua_cls);
     lua_setfield(globalLuaState, -2, "cls");
 
-    lua_pushcfunction(globalLuaState, lua_preload_spritesheet);
-    lua_setfield(globalLuaState, -2, "preload_spritesheet");
-
     lua_pushcfunction(globalLuaState, lua_draw_sprite);
     lua_setfield(globalLuaState, -2, "draw_sprite");
 
@@ -135,7 +230,74 @@ int main(void)
     lua_pushcfunction(globalLuaState, lua_fillp);
     lua_setfield(globalLuaState, -2, "fillp");
 
+    lua_pushcfunction(globalLuaState, lua_box);
+    lua_setfield(globalLuaState, -2, "box");
+
+    lua_pushcfunction(globalLuaState, lua_box_scratch);
+    lua_setfield(globalLuaState, -2, "box_scratch");
+
+    lua_pushcfunction(globalLuaState, lua_spatial);
+    lua_setfield(globalLuaState, -2, "spatial");
+
+    lua_pushcfunction(globalLuaState, lua_spatial_set);
+    lua_setfield(globalLuaState, -2, "spatial_set");
+
+    lua_pushcfunction(globalLuaState, lua_spatial_remove);
+    lua_setfield(globalLuaState, -2, "spatial_remove");
+
+    lua_pushcfunction(globalLuaState, lua_spatial_query);
+    lua_setfield(globalLuaState, -2, "spatial_query");
+
+    lua_pushcfunction(globalLuaState, lua_spatial_free);
+    lua_setfield(globalLuaState, -2, "spatial_free");
+
+    lua_pushcfunction(globalLuaState, lua_emitter);
+    lua_setfield(globalLuaState, -2, "emitter");
+
+    lua_pushcfunction(globalLuaState, lua_emitter_at);
+    lua_setfield(globalLuaState, -2, "emitter_at");
+
+    lua_pushcfunction(globalLuaState, lua_emitter_draw);
+    lua_setfield(globalLuaState, -2, "emitter_draw");
+
+    lua_pushcfunction(globalLuaState, lua_emitter_free);
+    lua_setfield(globalLuaState, -2, "emitter_free");
+
+    lua_pushcfunction(globalLuaState, lua_body);
+    lua_setfield(globalLuaState, -2, "body");
+
+    lua_pushcfunction(globalLuaState, lua_body_step);
+    lua_setfield(globalLuaState, -2, "body_step");
+
+    lua_pushcfunction(globalLuaState, lua_body_free);
+    lua_setfield(globalLuaState, -2, "body_free");
+
     lua_setglobal(globalLuaState, "ui");
+    open_box_type(globalLuaState);
+
+    texture_stats.budget_bytes = default_texture_budget_bytes;
+
+    lua_newtable(globalLuaState);
+
+    lua_pushcfunction(globalLuaState, lua_texture_budget);
+    lua_setfield(globalLuaState, -2, "texture_budget");
+
+    lua_pushcfunction(globalLuaState, lua_stats);
+    lua_setfield(globalLuaState, -2, "stats");
+
+    lua_pushcfunction(globalLuaState, lua_gc_collect);
+    lua_setfield(globalLuaState, -2, "gc_collect");
+
+    lua_pushcfunction(globalLuaState, lua_alloc_profile);
+    lua_setfield(globalLuaState, -2, "alloc_profile");
+
+    lua_pushcfunction(globalLuaState, lua_alloc_report);
+    lua_setfield(globalLuaState, -2, "alloc_report");
+
+    lua_pushcfunction(globalLuaState, lua_get_controller_state);
+    lua_setfield(globalLuaState, -2, "get_controller_state");
+
+    lua_setglobal(globalLuaState, "sys");
 
     // Expose button constants as globals
     // These match common gamepad button conventions
@@ -163,7 +325,21 @@ int main(void)
     lua_pushinteger(globalLuaState, GAMEPAD_BUTTON_RIGHT_FACE_DOWN);
     lua_setglobal(globalLuaState, "BTN_Z");
 
+    lua_pushinteger(globalLuaState, CONTACT_GROUND);
+    lua_setglobal(globalLuaState, "CONTACT_GROUND");
+
+    lua_pushinteger(globalLuaState, CONTACT_CEILING);
+    lua_setglobal(globalLuaState, "CONTACT_CEILING");
+
+    lua_pushinteger(globalLuaState, CONTACT_LEFT);
+    lua_setglobal(globalLuaState, "CONTACT_LEFT");
+
+    lua_pushinteger(globalLuaState, CONTACT_RIGHT);
+    lua_setglobal(globalLuaState, "CONTACT_RIGHT");
+
     InitWindow(screenWidth, screenHeight, "Lupi Emulator");
+    init_input();
+    init_decode_workers();
 
     // Add game-example directory to Lua's package.path so require() can find modules there
     lua_getglobal(globalLuaState, "package");
@@ -174,7 +350,11 @@ int main(void)
     lua_pushfstring(globalLuaState, "%s;./game-example/?.lua", current_path);
     lua_setfield(globalLuaState, -2, "path");
 
-    if (luaL_dofile(globalLuaState, "game-example/game.lua") != LUA_OK) {
+    // Modules load from the precompiled bytecode while it matches their source
+    install_bytecode_searcher(globalLuaState);
+
+    if (load_lua_chunk(globalLuaState, "game-example/game.lua") != LUA_OK
+        || lua_pcall(globalLuaState, 0, LUA_MULTRET, 0) != LUA_OK) {
         printf("Error loading game-example/game.lua: %s\n", lua_tostring(globalLuaState, -1));
         lua_pop(globalLuaState, 1);
     } else {
@@ -182,7 +362,7 @@ int main(void)
         load_sprites_in_memory_from_lua(globalLuaState);
     }
 
-    SetTargetFPS(60);
+    SetTargetFPS(target_fps);
 
 #if defined(PLATFORM_WEB)
     emscripten_set_main_loop(UpdateDrawFrame, 0, 1);